@@ -41,12 +41,27 @@
 #include <utils/optional.h>
 #include <utils/span.h>
 
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cstdint>
 #include <exception>
 #include <functional>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 using std::int64_t;
 
@@ -64,9 +79,44 @@ class SQLITE_EXPORT BaseStatement
 {
 public:
     using Database = ::Sqlite::Database;
+    using CompiledStatement = std::unique_ptr<sqlite3_stmt, void (*)(sqlite3_stmt *)>;
 
     explicit BaseStatement(Utils::SmallStringView sqlStatement, Database &database);
 
+    // Compiles sqlStatement with sqlite3_prepare_v3() and prepareFlags on databaseHandle, the
+    // connection of database, e.g. with SQLITE_PREPARE_PERSISTENT for a statement that is
+    // kept for long.
+    BaseStatement(Utils::SmallStringView sqlStatement,
+                  Database &database,
+                  sqlite3 *databaseHandle,
+                  unsigned int prepareFlags)
+        : m_compiledStatement{nullptr, deleteCompiledStatement}
+        , m_database{database}
+    {
+        sqlite3_stmt *compiledStatement = nullptr;
+        int resultCode = SQLITE_OK;
+        do {
+            resultCode = sqlite3_prepare_v3(databaseHandle,
+                                            sqlStatement.data(),
+                                            int(sqlStatement.size()),
+                                            prepareFlags,
+                                            &compiledStatement,
+                                            nullptr);
+            if (resultCode == SQLITE_LOCKED)
+                waitForUnlockNotify();
+        } while (resultCode == SQLITE_LOCKED);
+
+        m_compiledStatement.reset(compiledStatement);
+        if (resultCode != SQLITE_OK)
+            checkForPrepareError(resultCode);
+    }
+
+    // Takes over compiledStatement, which was compiled on the connection of database.
+    BaseStatement(CompiledStatement compiledStatement, Database &database)
+        : m_compiledStatement{std::move(compiledStatement)}
+        , m_database{database}
+    {}
+
     BaseStatement(const BaseStatement &) = delete;
     BaseStatement &operator=(const BaseStatement &) = delete;
 
@@ -147,11 +197,14 @@ public:
 
     Database &database() const;
 
+    // Leaves the statement without compiled statement, it can only be destroyed afterwards.
+    CompiledStatement takeCompiledStatement() { return std::move(m_compiledStatement); }
+
 protected:
     ~BaseStatement() = default;
 
 private:
-    std::unique_ptr<sqlite3_stmt, void (*)(sqlite3_stmt *)> m_compiledStatement;
+    CompiledStatement m_compiledStatement;
     Database &m_database;
 };
 
@@ -163,6 +216,501 @@ extern template SQLITE_EXPORT Utils::SmallStringView BaseStatement::fetchValue<U
 extern template SQLITE_EXPORT Utils::SmallString BaseStatement::fetchValue<Utils::SmallString>(int column) const;
 extern template SQLITE_EXPORT Utils::PathString BaseStatement::fetchValue<Utils::PathString>(int column) const;
 
+template<int ResultCount, int BindParameterCount>
+class CachedStatement;
+
+// Keeps compiled statements for SQL that is executed ad hoc, so that executing it again does
+// not prepare it again. Statements are keyed by their SQL and database, checked out for the
+// lifetime of a Lease and reset when they come back, the least recently returned ones are
+// deleted beyond the capacity. They are compiled with SQLITE_PREPARE_PERSISTENT unless the
+// preparation is Transient, only the first statement of a database is compiled before the
+// cache knows its connection. Like statements, a cache is used under the lock of its database
+// and has to be destroyed before the database.
+//
+//     auto statement = cache.statement<1, 1>("SELECT name FROM files WHERE id=?", database);
+//     auto name = statement->value<Utils::SmallString>(fileId);
+class StatementCache
+{
+    struct Entry
+    {
+        std::string sqlStatement;
+        BaseStatement::Database *database;
+        BaseStatement::CompiledStatement statement;
+    };
+
+    using Entries = std::list<Entry>;
+
+public:
+    enum class Preparation { Persistent, Transient };
+
+    template<typename Statement>
+    class Lease
+    {
+    public:
+        Lease(StatementCache &cache, std::string sqlStatement, std::unique_ptr<Statement> statement)
+            : m_cache{&cache}
+            , m_sqlStatement{std::move(sqlStatement)}
+            , m_statement{std::move(statement)}
+        {}
+
+        Lease(Lease &&other) = default;
+        Lease &operator=(Lease &&other) = delete;
+
+        ~Lease()
+        {
+            if (m_cache && m_statement)
+                m_cache->giveBack(std::move(m_sqlStatement), *m_statement);
+        }
+
+        Statement *operator->() const { return m_statement.get(); }
+        Statement &operator*() const { return *m_statement; }
+
+        // Deletes the statement instead of giving it back to the cache, e.g. if it turned out
+        // not to belong to the connection of the cache.
+        void discard() { m_statement.reset(); }
+
+    private:
+        StatementCache *m_cache;
+        std::string m_sqlStatement;
+        std::unique_ptr<Statement> m_statement;
+    };
+
+    explicit StatementCache(std::size_t capacity = 64,
+                            Preparation preparation = Preparation::Persistent)
+        : m_capacity{capacity}
+        , m_preparation{preparation}
+    {}
+
+    StatementCache(const StatementCache &) = delete;
+    StatementCache &operator=(const StatementCache &) = delete;
+
+    template<int ResultCount, int BindParameterCount = 0>
+    Lease<CachedStatement<ResultCount, BindParameterCount>> statement(
+        Utils::SmallStringView sqlStatement, BaseStatement::Database &database)
+    {
+        using Statement = CachedStatement<ResultCount, BindParameterCount>;
+
+        std::string key{sqlStatement.data(), sqlStatement.size()};
+        auto [begin, end] = m_index.equal_range(key);
+        for (auto found = begin; found != end; ++found) {
+            if (found->second->database != &database)
+                continue;
+
+            ++m_hits;
+            Entries::iterator entry = found->second;
+            BaseStatement::CompiledStatement compiledStatement = std::move(entry->statement);
+            m_index.erase(found);
+            m_entries.erase(entry);
+            return {*this,
+                    std::move(key),
+                    std::make_unique<Statement>(std::move(compiledStatement), database)};
+        }
+
+        ++m_misses;
+        const auto handle = m_databaseHandles.find(&database);
+        if (m_preparation == Preparation::Persistent && handle != m_databaseHandles.end()) {
+            return {*this,
+                    std::move(key),
+                    std::make_unique<Statement>(sqlStatement,
+                                                database,
+                                                handle->second,
+                                                SQLITE_PREPARE_PERSISTENT)};
+        }
+
+        auto statement = std::make_unique<Statement>(sqlStatement, database);
+        m_databaseHandles.emplace(&database, statement->sqliteDatabaseHandle());
+        return {*this, std::move(key), std::move(statement)};
+    }
+
+    std::size_t hits() const { return m_hits; }
+    std::size_t misses() const { return m_misses; }
+    std::size_t size() const { return m_entries.size(); }
+    std::size_t capacity() const { return m_capacity; }
+
+    void clear()
+    {
+        m_index.clear();
+        m_entries.clear();
+        m_databaseHandles.clear();
+    }
+
+private:
+    void giveBack(std::string sqlStatement, BaseStatement &statement)
+    {
+        statement.reset();
+        m_entries.push_front(
+            {std::move(sqlStatement), &statement.database(), statement.takeCompiledStatement()});
+        m_index.emplace(m_entries.front().sqlStatement, m_entries.begin());
+
+        while (m_entries.size() > m_capacity) {
+            const auto last = std::prev(m_entries.end());
+            auto [begin, end] = m_index.equal_range(last->sqlStatement);
+            for (auto found = begin; found != end; ++found) {
+                if (found->second == last) {
+                    m_index.erase(found);
+                    break;
+                }
+            }
+            m_entries.erase(last);
+        }
+    }
+
+    Entries m_entries;
+    std::unordered_multimap<std::string, Entries::iterator> m_index;
+    std::unordered_map<BaseStatement::Database *, sqlite3 *> m_databaseHandles;
+    std::size_t m_capacity;
+    Preparation m_preparation;
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+};
+
+// Spreads queries over connections to one database in WAL mode: read-only statements, as
+// reported by BaseStatement::isReadOnlyStatement(), run on a reader connection of the
+// calling thread, everything else on the single writer. In WAL mode readers see the last
+// committed state and do not wait for the writer, so reads scale with the threads. The
+// reader factory opens a new connection to the database file of the writer. The pool switches
+// the writer and every reader to WAL mode and throws PragmaValueNotSet if that does not
+// stick, e.g. for an in-memory database. The reader of a thread is closed when the thread
+// ends or releases it.
+//
+// Transaction statements like BEGIN and COMMIT always run on the writer. A transaction over
+// several statements belongs into withWriter(), which keeps the writer locked for the thread
+// and runs all its statements on the writer, so that reads see the uncommitted writes.
+//
+//     ConnectionPool<Sqlite::Database> pool{database, [&] {
+//         return std::make_unique<Sqlite::Database>(database.databaseFilePath());
+//     }};
+//     auto names = pool.withStatement<1, 1>(
+//         "SELECT name FROM files WHERE directoryId=?",
+//         [&](auto &statement) { return statement.template values<Utils::SmallString>(16, id); });
+template<typename Database>
+class ConnectionPool
+{
+public:
+    using ReaderFactory = std::function<std::unique_ptr<Database>()>;
+
+    ConnectionPool(Database &writer,
+                   ReaderFactory createReader,
+                   std::size_t statementCacheSize = 64)
+        : m_writer{writer}
+        , m_writerStatements{statementCacheSize}
+        , m_createReader{std::move(createReader)}
+        , m_statementCacheSize{statementCacheSize}
+    {
+        std::lock_guard<Database> lock{m_writer};
+        setWalMode(m_writer);
+    }
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // Calls callable with a ready to bind CachedStatement for sqlStatement on the connection
+    // that fits it and returns its result. The connection is locked meanwhile.
+    template<int ResultCount, int BindParameterCount = 0, typename Callable>
+    decltype(auto) withStatement(Utils::SmallStringView sqlStatement, Callable &&callable)
+    {
+        if (!ownsWriter() && !isTransactionStatement(sqlStatement)
+            && !isKnownWriteStatement(sqlStatement)) {
+            Reader &reader = readerOfThisThread();
+            std::lock_guard<Database> lock{*reader.database};
+            auto statement = reader.statements.template statement<ResultCount, BindParameterCount>(
+                sqlStatement, *reader.database);
+            if (statement->isReadOnlyStatement())
+                return std::invoke(callable, *statement);
+
+            statement.discard();
+            rememberWriteStatement(sqlStatement);
+        }
+
+        return withWriter([&]() -> decltype(auto) {
+            auto statement = m_writerStatements.template statement<ResultCount, BindParameterCount>(
+                sqlStatement, m_writer);
+            return std::invoke(callable, *statement);
+        });
+    }
+
+    // Calls callable with the writer locked for the calling thread and returns its result.
+    // Calls of withStatement() and withWriter() by the thread meanwhile run on the writer
+    // without locking it again. Transaction objects lock the writer themselves, inside
+    // callable transactions are BEGIN and COMMIT statements run with withStatement().
+    template<typename Callable>
+    decltype(auto) withWriter(Callable &&callable)
+    {
+        if (ownsWriter())
+            return std::invoke(callable);
+
+        std::lock_guard<Database> lock{m_writer};
+        struct OwnerResetter
+        {
+            ~OwnerResetter() { owner = std::thread::id{}; }
+
+            std::atomic<std::thread::id> &owner;
+        } ownerResetter{m_writerOwner};
+        m_writerOwner = std::this_thread::get_id();
+
+        return std::invoke(callable);
+    }
+
+    Database &writer() { return m_writer; }
+
+    std::size_t readerCount() const
+    {
+        std::lock_guard<std::mutex> lock{m_readers->mutex};
+        return m_readers->readers.size();
+    }
+
+    // Closes the reader of the calling thread before the thread ends, e.g. for a thread that
+    // is idle for long.
+    void releaseReaderOfThisThread() { m_readers->release(std::this_thread::get_id()); }
+
+private:
+    struct Reader
+    {
+        Reader(std::unique_ptr<Database> database, std::size_t statementCacheSize)
+            : database{std::move(database)}
+            , statements{statementCacheSize}
+        {}
+
+        ~Reader()
+        {
+            // The statements have to go before their connection.
+            statements.clear();
+        }
+
+        std::unique_ptr<Database> database;
+        StatementCache statements;
+    };
+
+    // Shared with the threads that have a reader, so that a thread that ends after the pool
+    // does not touch it.
+    struct Readers
+    {
+        void release(std::thread::id thread)
+        {
+            std::unique_ptr<Reader> reader;
+            std::lock_guard<std::mutex> lock{mutex};
+            const auto found = readers.find(thread);
+            if (found == readers.end())
+                return;
+            reader = std::move(found->second);
+            readers.erase(found);
+        }
+
+        mutable std::mutex mutex;
+        std::unordered_map<std::thread::id, std::unique_ptr<Reader>> readers;
+    };
+
+    // Closes the readers of a thread in the pools that still exist when the thread ends.
+    class ThreadExitHook
+    {
+    public:
+        ~ThreadExitHook()
+        {
+            const std::thread::id thread = std::this_thread::get_id();
+            for (const std::weak_ptr<Readers> &pool : m_pools) {
+                if (const std::shared_ptr<Readers> readers = pool.lock())
+                    readers->release(thread);
+            }
+        }
+
+        void add(const std::shared_ptr<Readers> &readers)
+        {
+            m_pools.erase(std::remove_if(m_pools.begin(),
+                                         m_pools.end(),
+                                         [](const std::weak_ptr<Readers> &pool) {
+                                             return pool.expired();
+                                         }),
+                          m_pools.end());
+            m_pools.push_back(readers);
+        }
+
+    private:
+        std::vector<std::weak_ptr<Readers>> m_pools;
+    };
+
+    static void setWalMode(Database &database)
+    {
+        database.setJournalMode(JournalMode::Wal);
+        if (database.journalMode() != JournalMode::Wal)
+            throw PragmaValueNotSet{"ConnectionPool: The database is not in WAL mode!"};
+    }
+
+    Reader &readerOfThisThread()
+    {
+        const std::thread::id thread = std::this_thread::get_id();
+        {
+            std::lock_guard<std::mutex> lock{m_readers->mutex};
+            const auto found = m_readers->readers.find(thread);
+            if (found != m_readers->readers.end())
+                return *found->second;
+        }
+
+        // Opening a connection takes a while, other threads need not wait for it.
+        auto reader = std::make_unique<Reader>(m_createReader(), m_statementCacheSize);
+        {
+            std::lock_guard<Database> lock{*reader->database};
+            setWalMode(*reader->database);
+        }
+        static thread_local ThreadExitHook threadExitHook;
+        threadExitHook.add(m_readers);
+
+        std::lock_guard<std::mutex> lock{m_readers->mutex};
+        return *m_readers->readers.emplace(thread, std::move(reader)).first->second;
+    }
+
+    bool ownsWriter() const { return m_writerOwner == std::this_thread::get_id(); }
+
+    // isReadOnlyStatement() is true for them, but on a reader they would not guard anything.
+    static bool isTransactionStatement(Utils::SmallStringView sqlStatement)
+    {
+        const auto character = [&](std::size_t index) {
+            return static_cast<unsigned char>(sqlStatement[index]);
+        };
+
+        std::size_t index = 0;
+        while (index < sqlStatement.size() && std::isspace(character(index)))
+            ++index;
+        std::string keyword;
+        for (; index < sqlStatement.size() && std::isalpha(character(index)); ++index)
+            keyword += char(std::toupper(character(index)));
+
+        return keyword == "BEGIN" || keyword == "COMMIT" || keyword == "END"
+               || keyword == "ROLLBACK" || keyword == "SAVEPOINT" || keyword == "RELEASE";
+    }
+
+    bool isKnownWriteStatement(Utils::SmallStringView sqlStatement) const
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_writeStatements.count(std::string{sqlStatement.data(), sqlStatement.size()});
+    }
+
+    void rememberWriteStatement(Utils::SmallStringView sqlStatement)
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_writeStatements.emplace(sqlStatement.data(), sqlStatement.size());
+    }
+
+    Database &m_writer;
+    std::atomic<std::thread::id> m_writerOwner{std::thread::id{}};
+    StatementCache m_writerStatements;
+    ReaderFactory m_createReader;
+    std::size_t m_statementCacheSize;
+    mutable std::mutex m_mutex;
+    std::shared_ptr<Readers> m_readers = std::make_shared<Readers>();
+    // Statements that were prepared on a reader once and turned out to write.
+    std::unordered_set<std::string> m_writeStatements;
+};
+
+// Views point into the current row of the statement and die at the next step.
+template<typename Type>
+constexpr bool isColumnViewType = std::is_same_v<Type, Utils::SmallStringView>
+                                  || std::is_same_v<Type, BlobView>
+                                  || std::is_same_v<Type, ValueView>;
+
+// Results in struct-of-arrays layout: one contiguous vector per column plus a bitmap of the
+// NULL values, so that scans over many rows can work column by column. NULL values are stored
+// as value-initialized entries. The columns hold many rows, so their types must own their
+// values, e.g. Utils::SmallString instead of Utils::SmallStringView.
+template<typename... ColumnTypes>
+class ColumnBatch
+{
+    static_assert((!isColumnViewType<ColumnTypes> && ...),
+                  "ColumnBatch columns must be owning types, views die at the next step!");
+
+public:
+    template<typename ValueType>
+    class Column
+    {
+    public:
+        using value_type = ValueType;
+
+        const std::vector<ValueType> &values() const { return m_values; }
+        const ValueType *data() const { return m_values.data(); }
+        std::size_t size() const { return m_values.size(); }
+        const ValueType &operator[](std::size_t row) const { return m_values[row]; }
+
+        // One bit per row, set for NULL values.
+        const std::vector<std::uint64_t> &nullBitmap() const { return m_nullBitmap; }
+        bool isNull(std::size_t row) const
+        {
+            return m_nullBitmap[row / 64] & (std::uint64_t{1} << (row % 64));
+        }
+        bool hasNulls() const { return m_hasNulls; }
+
+    private:
+        friend ColumnBatch;
+
+        void reserve(std::size_t rowCount)
+        {
+            m_values.reserve(rowCount);
+            m_nullBitmap.reserve((rowCount + 63) / 64);
+        }
+
+        void clear()
+        {
+            m_values.clear();
+            m_nullBitmap.clear();
+            m_hasNulls = false;
+        }
+
+        template<typename Statement>
+        void append(const Statement &statement, int column)
+        {
+            const std::size_t row = m_values.size();
+            if (row % 64 == 0)
+                m_nullBitmap.push_back(0);
+
+            if (statement.fetchType(column) == Sqlite::Type::Null) {
+                m_values.emplace_back();
+                m_nullBitmap.back() |= std::uint64_t{1} << (row % 64);
+                m_hasNulls = true;
+            } else {
+                m_values.push_back(statement.template fetchValue<ValueType>(column));
+            }
+        }
+
+        std::vector<ValueType> m_values;
+        std::vector<std::uint64_t> m_nullBitmap;
+        bool m_hasNulls = false;
+    };
+
+    static constexpr int columnCount = int(sizeof...(ColumnTypes));
+
+    std::size_t size() const { return std::get<0>(m_columns).size(); }
+    bool empty() const { return size() == 0; }
+
+    template<int ColumnIndex>
+    const auto &column() const
+    {
+        return std::get<ColumnIndex>(m_columns);
+    }
+
+    void reserve(std::size_t rowCount)
+    {
+        std::apply([&](auto &...columns) { (columns.reserve(rowCount), ...); }, m_columns);
+    }
+
+    void clear()
+    {
+        std::apply([](auto &...columns) { (columns.clear(), ...); }, m_columns);
+    }
+
+    template<typename Statement>
+    void appendRow(const Statement &statement)
+    {
+        appendRow(statement, std::make_integer_sequence<int, columnCount>{});
+    }
+
+private:
+    template<typename Statement, int... ColumnIndices>
+    void appendRow(const Statement &statement, std::integer_sequence<int, ColumnIndices...>)
+    {
+        (std::get<ColumnIndices>(m_columns).append(statement, ColumnIndices), ...);
+    }
+
+    std::tuple<Column<ColumnTypes>...> m_columns;
+};
+
 template<typename BaseStatement, int ResultCount, int BindParameterCount>
 class StatementImplementation : public BaseStatement
 {
@@ -194,6 +742,111 @@ public:
         BaseStatement::next();
     }
 
+    // Writes every row of rows in one immediate transaction, binding the fields that
+    // projection returns for a row: a tuple (e.g. std::tie() of the members of a struct) or,
+    // for a single parameter, the value. The statement is locked, reset and committed once,
+    // not per row. Must not be called inside another transaction.
+    template<typename Range, typename Projection>
+    void writeBatch(const Range &rows, Projection &&projection)
+    {
+        ImmediateTransaction<typename BaseStatement::Database> transaction{
+            BaseStatement::database()};
+        Resetter resetter{this};
+
+        for (const auto &row : rows) {
+            bindRow(0, std::invoke(projection, row));
+            BaseStatement::next();
+            BaseStatement::reset();
+        }
+
+        resetter.reset();
+        transaction.commit();
+    }
+
+    template<typename Range>
+    void writeBatch(const Range &rows)
+    {
+        writeBatch(rows, [](const auto &row) -> const auto & { return row; });
+    }
+
+    // Like writeBatch(), but appends a VALUES list of as many rows as the parameter limit
+    // allows to insertStatement, e.g. "INSERT INTO files(id, name)", so that one step inserts
+    // many rows. BindParameterCount is the parameter count of one row. maximumParameterCount
+    // is the parameter limit of the connection, which the caller gets with
+    // sqlite3_limit(handle, SQLITE_LIMIT_VARIABLE_NUMBER, -1): 999 before SQLite 3.32 unless
+    // the build or the connection sets another one.
+    template<typename Range, typename Projection>
+    static void writeBatchWithValuesList(Utils::SmallStringView insertStatement,
+                                         Database &database,
+                                         const Range &rows,
+                                         Projection &&projection,
+                                         int maximumParameterCount)
+    {
+        static_assert(ResultCount == 0, "Only for statements without results!");
+        static_assert(BindParameterCount > 0, "Rows need parameters!");
+
+        struct ValuesStatement final : StatementImplementation
+        {
+            ValuesStatement(Utils::SmallStringView sqlStatement, Database &database)
+                : StatementImplementation(sqlStatement, database)
+            {}
+        };
+
+        const auto createStatement = [&](std::size_t rowCount) {
+            std::string row = "(?";
+            for (int parameter = 1; parameter < BindParameterCount; ++parameter)
+                row += ",?";
+            row += ')';
+
+            std::string sqlStatement{insertStatement.data(), insertStatement.size()};
+            sqlStatement.reserve(sqlStatement.size() + 8 + rowCount * (row.size() + 1));
+            sqlStatement += " VALUES ";
+            for (std::size_t index = 0; index < rowCount; ++index) {
+                if (index > 0)
+                    sqlStatement += ',';
+                sqlStatement += row;
+            }
+
+            return std::make_unique<ValuesStatement>(
+                Utils::SmallStringView{sqlStatement.data(), sqlStatement.size()}, database);
+        };
+
+        const std::size_t rowCount = std::size_t(std::distance(std::begin(rows), std::end(rows)));
+
+        ImmediateTransaction<Database> transaction{database};
+
+        const std::size_t rowsPerStatement = std::max<std::size_t>(
+            1, std::size_t(maximumParameterCount / BindParameterCount));
+
+        std::unique_ptr<ValuesStatement> statement;
+        std::size_t statementRowCount = 0;
+        std::size_t boundRowCount = 0;
+        std::size_t remainingRowCount = rowCount;
+        for (const auto &row : rows) {
+            if (boundRowCount == 0) {
+                // All statements but the last one have the full row count.
+                const std::size_t nextRowCount = std::min(rowsPerStatement, remainingRowCount);
+                if (!statement || statementRowCount != nextRowCount) {
+                    statement = createStatement(nextRowCount);
+                    statementRowCount = nextRowCount;
+                }
+            }
+
+            statement->bindRow(int(boundRowCount) * BindParameterCount,
+                               std::invoke(projection, row));
+            --remainingRowCount;
+
+            if (++boundRowCount == statementRowCount) {
+                statement->next();
+                statement->reset();
+                boundRowCount = 0;
+            }
+        }
+
+        statement.reset();
+        transaction.commit();
+    }
+
     template<typename ResultType, typename... QueryTypes>
     auto values(std::size_t reserveSize, const QueryTypes &...queryValues)
     {
@@ -211,6 +864,82 @@ public:
         return resultValues;
     }
 
+    // Fetches all rows into a ColumnBatch<ColumnTypes...> instead of a vector of rows.
+    template<typename BatchType, typename... QueryTypes>
+    auto columnValues(std::size_t reserveSize, const QueryTypes &...queryValues)
+    {
+        static_assert(BatchType::columnCount == ResultCount, "Wrong column count!");
+
+        Resetter resetter{this};
+        BatchType batch;
+        batch.reserve(std::max(reserveSize, m_maximumResultCount));
+
+        bindValues(queryValues...);
+
+        while (BaseStatement::next())
+            batch.appendRow(*this);
+
+        setMaximumResultCount(batch.size());
+
+        return batch;
+    }
+
+    // Steps up to batchSize rows at a time into one reused ColumnBatch<ColumnTypes...> and calls
+    // callable with it after each step, like readCallback() does per row.
+    template<typename BatchType, typename Callable, typename... QueryTypes>
+    void readColumnBatches(std::size_t batchSize,
+                           Callable &&callable,
+                           const QueryTypes &...queryValues)
+    {
+        static_assert(BatchType::columnCount == ResultCount, "Wrong column count!");
+
+        Resetter resetter{this};
+        BatchType batch;
+        batchSize = std::max<std::size_t>(batchSize, 1);
+        batch.reserve(batchSize);
+
+        bindValues(queryValues...);
+
+        // Steps only when the batch has room, so the statement is never a row ahead of the
+        // callback.
+        bool hasNext = true;
+        while (hasNext) {
+            batch.clear();
+            while (batch.size() < batchSize && (hasNext = BaseStatement::next()))
+                batch.appendRow(*this);
+
+            if (batch.empty())
+                break;
+
+            const CallbackControl control = std::invoke(callable, std::as_const(batch));
+            if (control == CallbackControl::Abort)
+                break;
+        }
+    }
+
+    // Like values(), but the vector and, for result types that use allocators, their strings
+    // are allocated from resource, e.g. a std::pmr::monotonic_buffer_resource that is freed
+    // in one step. Text columns are passed as Utils::SmallStringView to the constructor of
+    // the result type, which copies them with its allocator.
+    template<typename ResultType, typename... QueryTypes>
+    auto values(std::pmr::memory_resource &resource,
+                std::size_t reserveSize,
+                const QueryTypes &...queryValues)
+    {
+        Resetter resetter{this};
+        std::pmr::vector<ResultType> resultValues{&resource};
+        resultValues.reserve(std::max(reserveSize, m_maximumResultCount));
+
+        bindValues(queryValues...);
+
+        while (BaseStatement::next())
+            emplaceBackValues(resultValues);
+
+        setMaximumResultCount(resultValues.size());
+
+        return resultValues;
+    }
+
     template<typename ResultType, typename... QueryTypes>
     auto value(const QueryTypes &...queryValues)
     {
@@ -251,6 +980,13 @@ public:
         return statement.template fetchValue<Type>(0);
     }
 
+    // Like toValue(), but the statement is prepared only the first time. Defined after
+    // CachedStatement.
+    template<typename Type>
+    static Type toValue(Utils::SmallStringView sqlStatement,
+                        Database &database,
+                        StatementCache &statementCache);
+
     template<typename Callable, typename... QueryTypes>
     void readCallback(Callable &&callable, const QueryTypes &...queryValues)
     {
@@ -277,6 +1013,50 @@ public:
             emplaceBackValues(container);
     }
 
+    // Calls sink with the values of each row, like readCallback() without the option to
+    // abort. Text columns can be taken as Utils::SmallStringView, which is valid during the call.
+    template<typename Sink, typename... QueryTypes>
+    void readToSink(Sink &&sink, const QueryTypes &...queryValues)
+    {
+        Resetter resetter{this};
+
+        bindValues(queryValues...);
+
+        while (BaseStatement::next())
+            callSink(sink, std::make_integer_sequence<int, ResultCount>{});
+    }
+
+    // Writes a ResultType per row to out, e.g. a std::inserter() into a hash map, and returns
+    // the iterator after the last row.
+    template<typename ResultType, typename OutputIterator, typename... QueryTypes>
+    OutputIterator readToIterator(OutputIterator out, const QueryTypes &...queryValues)
+    {
+        Resetter resetter{this};
+
+        bindValues(queryValues...);
+
+        while (BaseStatement::next())
+            *out++ = createValue<ResultType>();
+
+        return out;
+    }
+
+    // Fills a pre-sized span and returns the number of rows written, at most the size of the
+    // span. Further rows are not read.
+    template<typename ResultType, typename... QueryTypes>
+    std::size_t readToSpan(Utils::span<ResultType> span, const QueryTypes &...queryValues)
+    {
+        Resetter resetter{this};
+
+        bindValues(queryValues...);
+
+        std::size_t rowCount = 0;
+        while (rowCount < span.size() && BaseStatement::next())
+            span[rowCount++] = createValue<ResultType>();
+
+        return rowCount;
+    }
+
     template<typename ResultType, typename... QueryTypes>
     auto range(const QueryTypes &...queryValues)
     {
@@ -459,6 +1239,34 @@ private:
         int column;
     };
 
+    template<typename Type, typename = void>
+    struct IsTupleLike : std::false_type
+    {};
+
+    template<typename Type>
+    struct IsTupleLike<Type, std::void_t<decltype(std::tuple_size<Type>::value)>> : std::true_type
+    {};
+
+    template<typename Fields>
+    void bindRow(int firstIndex, const Fields &fields)
+    {
+        if constexpr (IsTupleLike<Fields>::value) {
+            static_assert(BindParameterCount == std::tuple_size_v<Fields>,
+                          "Wrong binding parameter count!");
+
+            std::apply(
+                [&, this](const auto &...values) {
+                    int index = firstIndex;
+                    (this->BaseStatement::bind(++index, values), ...);
+                },
+                fields);
+        } else {
+            static_assert(BindParameterCount == 1, "Wrong binding parameter count!");
+
+            BaseStatement::bind(firstIndex + 1, fields);
+        }
+    }
+
     template<typename ContainerType, int... ColumnIndices>
     void emplaceBackValues(ContainerType &container, std::integer_sequence<int, ColumnIndices...>)
     {
@@ -507,6 +1315,12 @@ private:
         return callCallable(callable, std::make_integer_sequence<int, ResultCount>{});
     }
 
+    template<typename Sink, int... ColumnIndices>
+    void callSink(Sink &&sink, std::integer_sequence<int, ColumnIndices...>)
+    {
+        std::invoke(sink, ValueGetter(*this, ColumnIndices)...);
+    }
+
     void setMaximumResultCount(std::size_t count)
     {
         m_maximumResultCount = std::max(m_maximumResultCount, count);
@@ -516,4 +1330,34 @@ public:
     std::size_t m_maximumResultCount = 0;
 };
 
+// The statements of a StatementCache, with the checks of ReadStatement and WriteStatement for
+// the parameter and column count when they are compiled or taken out of the cache.
+template<int ResultCount, int BindParameterCount>
+class CachedStatement final
+    : public StatementImplementation<BaseStatement, ResultCount, BindParameterCount>
+{
+    using Base = StatementImplementation<BaseStatement, ResultCount, BindParameterCount>;
+
+public:
+    template<typename... Arguments>
+    CachedStatement(Arguments &&...arguments)
+        : Base(std::forward<Arguments>(arguments)...)
+    {
+        Base::checkBindingParameterCount(BindParameterCount);
+        Base::checkColumnCount(ResultCount);
+    }
+};
+
+template<typename BaseStatement, int ResultCount, int BindParameterCount>
+template<typename Type>
+Type StatementImplementation<BaseStatement, ResultCount, BindParameterCount>::toValue(
+    Utils::SmallStringView sqlStatement, Database &database, StatementCache &statementCache)
+{
+    auto statement = statementCache.statement<1>(sqlStatement, database);
+
+    statement->next();
+
+    return statement->template fetchValue<Type>(0);
+}
+
 } // namespace Sqlite
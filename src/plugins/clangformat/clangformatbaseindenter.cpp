@@ -24,375 +24,62 @@
 ****************************************************************************/
 
 #include "clangformatbaseindenter.h"
-#include "clangformatconstants.h"
+#include "clangformatbenchmark.h"
+#include "clangformatcalibration.h"
+#include "clangformatdocumentstate.h"
+#include "clangformatformatter.h"
+#include "clangformatindentationbuffer.h"
+#include "clangformatmemory.h"
+#include "clangformatnativeindenter.h"
+#include "clangformatreplacementapplier.h"
+#include "clangformatreprobundle.h"
 #include "clangformatsettings.h"
+#include "clangformatstatistics.h"
+#include "clangformattextscanner.h"
+#include "clangformattr.h"
 #include "clangformatutils.h"
 
 #include <coreplugin/icore.h>
-#include <projectexplorer/editorconfiguration.h>
-#include <projectexplorer/project.h>
-#include <projectexplorer/session.h>
-#include <texteditor/icodestylepreferences.h>
-#include <texteditor/texteditorsettings.h>
 
-#include <clang/Tooling/Core/Replacement.h>
+#include <extensionsystem/pluginmanager.h>
 
 #include <utils/algorithm.h>
+#include <utils/async.h>
 #include <utils/fileutils.h>
+#include <utils/futuresynchronizer.h>
 #include <utils/qtcassert.h>
 #include <utils/textutils.h>
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QTextDocument>
+#include <QTimer>
 
 namespace ClangFormat {
 
-namespace {
-void adjustFormatStyleForLineBreak(clang::format::FormatStyle &style,
-                                   ReplacementsToKeep replacementsToKeep)
-{
-    style.MaxEmptyLinesToKeep = 100;
-#if LLVM_VERSION_MAJOR > 20
-    style.SortIncludes = {.Enabled = false};
-#elif LLVM_VERSION_MAJOR >= 13
-    style.SortIncludes = clang::format::FormatStyle::SI_Never;
-#else
-    style.SortIncludes = false;
-#endif
-#if LLVM_VERSION_MAJOR >= 16
-    style.SortUsingDeclarations = clang::format::FormatStyle::SUD_Never;
-#else
-    style.SortUsingDeclarations = false;
-#endif
-
-    // This is a separate pass, don't do it unless it's the full formatting.
-    style.FixNamespaceComments = false;
-#if LLVM_VERSION_MAJOR >= 16
-    style.AlignTrailingComments = {clang::format::FormatStyle::TCAS_Never, 0};
-#else
-    style.AlignTrailingComments = false;
-#endif
-
-    if (replacementsToKeep == ReplacementsToKeep::IndentAndBefore)
-        return;
-
-    style.ColumnLimit = 0;
-#ifdef KEEP_LINE_BREAKS_FOR_NON_EMPTY_LINES_BACKPORTED
-    style.KeepLineBreaksForNonEmptyLines = true;
-#endif
-}
-
-llvm::StringRef clearExtraNewline(llvm::StringRef text)
-{
-#if LLVM_VERSION_MAJOR >= 16
-    while (text.starts_with("\n\n"))
-#else
-    while (text.startswith("\n\n"))
-#endif
-        text = text.drop_front();
-    return text;
-}
-
-clang::tooling::Replacements filteredReplacements(const QByteArray &buffer,
-                                                  const clang::tooling::Replacements &replacements,
-                                                  int utf8Offset,
-                                                  int utf8Length,
-                                                  ReplacementsToKeep replacementsToKeep)
-{
-    clang::tooling::Replacements filtered;
-    for (const clang::tooling::Replacement &replacement : replacements) {
-        int replacementOffset = static_cast<int>(replacement.getOffset());
-
-        // Skip everything after.
-        if (replacementOffset >= utf8Offset + utf8Length)
-            return filtered;
-
-        const bool isNotIndentOrInRange = replacementOffset < utf8Offset - 1
-                                          || buffer.at(replacementOffset) != '\n';
-        if (isNotIndentOrInRange && replacementsToKeep == ReplacementsToKeep::OnlyIndent)
-            continue;
-
-        llvm::StringRef text = replacementsToKeep == ReplacementsToKeep::OnlyIndent
-                                   ? clearExtraNewline(replacement.getReplacementText())
-                                   : replacement.getReplacementText();
-        if (replacementsToKeep == ReplacementsToKeep::OnlyIndent && int(text.count('\n'))
-                != buffer.mid(replacementOffset, replacement.getLength()).count('\n')) {
-            continue;
-        }
-
-
-        llvm::Error error = filtered.add(
-            clang::tooling::Replacement(replacement.getFilePath(),
-                                        static_cast<unsigned int>(replacementOffset),
-                                        replacement.getLength(),
-                                        text));
-        // Throws if error is not checked.
-        if (error) {
-            error = llvm::handleErrors(std::move(error),
-                                       [](const llvm::ErrorInfoBase &) -> llvm::Error {
-                                           return llvm::Error::success();
-                                       });
-            QTC_CHECK(!error && "Error must be a \"success\" at this point");
-            break;
-        }
-    }
-    return filtered;
-}
+Q_LOGGING_CATEGORY(clangIndenterLog, "qtc.clangformat.indenter", QtWarningMsg)
 
+namespace {
 void trimRHSWhitespace(const QTextBlock &block)
 {
-    const QString initialText = block.text();
-    if (!initialText.rbegin()->isSpace())
+    // Within an edit block, the indentation of the previous block may have changed the document
+    // without a new revision, so the characters that are removed are read from the document.
+    const QTextDocument *doc = block.document();
+    const int blockEnd = block.position() + block.length() - 1;
+    int extraSpaceCount = 0;
+    while (blockEnd - extraSpaceCount > block.position()
+           && doc->characterAt(blockEnd - extraSpaceCount - 1).isSpace()) {
+        ++extraSpaceCount;
+    }
+    if (extraSpaceCount == 0)
         return;
 
-    auto lastNonSpace = std::find_if_not(initialText.rbegin(),
-                                         initialText.rend(),
-                                         [](const QChar &letter) { return letter.isSpace(); });
-    const int extraSpaceCount = static_cast<int>(std::distance(initialText.rbegin(), lastNonSpace));
-
     QTextCursor cursor(block);
-    cursor.movePosition(QTextCursor::Right,
-                        QTextCursor::MoveAnchor,
-                        initialText.size() - extraSpaceCount);
-    cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor, extraSpaceCount);
+    cursor.setPosition(blockEnd - extraSpaceCount);
+    cursor.setPosition(blockEnd, QTextCursor::KeepAnchor);
     cursor.removeSelectedText();
 }
 
-QTextBlock reverseFindLastEmptyBlock(QTextBlock start)
-{
-    if (start.position() > 0) {
-        start = start.previous();
-        while (start.position() > 0 && start.text().trimmed().isEmpty())
-            start = start.previous();
-        if (!start.text().trimmed().isEmpty())
-            start = start.next();
-    }
-    return start;
-}
-
-enum class CharacterContext {
-    AfterComma,
-    LastAfterComma,
-    NewStatementOrContinuation,
-    IfOrElseWithoutScope,
-    Unknown
-};
-
-QChar findFirstNonWhitespaceCharacter(const QTextBlock &currentBlock)
-{
-    const QTextDocument *doc = currentBlock.document();
-    int currentPos = currentBlock.position();
-    while (currentPos < doc->characterCount() && doc->characterAt(currentPos).isSpace())
-        ++currentPos;
-    return currentPos < doc->characterCount() ? doc->characterAt(currentPos) : QChar::Null;
-}
-
-int findMatchingOpeningParen(const QTextBlock &blockEndingWithClosingParen)
-{
-    const QTextDocument *doc = blockEndingWithClosingParen.document();
-    int currentPos = blockEndingWithClosingParen.position()
-                     + blockEndingWithClosingParen.text().lastIndexOf(')');
-    int parenBalance = 1;
-
-    while (currentPos > 0 && parenBalance > 0) {
-        --currentPos;
-        if (doc->characterAt(currentPos) == ')')
-            ++parenBalance;
-        if (doc->characterAt(currentPos) == '(')
-            --parenBalance;
-    }
-
-    if (parenBalance == 0)
-        return currentPos;
-
-    return -1;
-}
-
-bool comesDirectlyAfterIf(const QTextDocument *doc, int pos)
-{
-    --pos;
-    while (pos > 0 && doc->characterAt(pos).isSpace())
-        --pos;
-    return pos > 0 && doc->characterAt(pos) == 'f' && doc->characterAt(pos - 1) == 'i';
-}
-
-CharacterContext characterContext(const QTextBlock &currentBlock,
-                                  const QTextBlock &previousNonEmptyBlock)
-{
-    const QString prevLineText = previousNonEmptyBlock.text().trimmed();
-    if (prevLineText.isEmpty())
-        return CharacterContext::NewStatementOrContinuation;
-
-    const QChar firstNonWhitespaceChar = findFirstNonWhitespaceCharacter(currentBlock);
-    if (prevLineText.endsWith(',')) {
-        // We don't need to add comma in case it's the last argument.
-        if (firstNonWhitespaceChar == '}' || firstNonWhitespaceChar == ')')
-            return CharacterContext::LastAfterComma;
-        return CharacterContext::AfterComma;
-    }
-
-    if (prevLineText.endsWith("else"))
-        return CharacterContext::IfOrElseWithoutScope;
-    if (prevLineText.endsWith(')')) {
-        const int pos = findMatchingOpeningParen(previousNonEmptyBlock);
-        if (pos >= 0 && comesDirectlyAfterIf(previousNonEmptyBlock.document(), pos))
-            return CharacterContext::IfOrElseWithoutScope;
-    }
-
-    return CharacterContext::NewStatementOrContinuation;
-}
-
-bool nextBlockExistsAndEmpty(const QTextBlock &currentBlock)
-{
-    QTextBlock nextBlock = currentBlock.next();
-    if (!nextBlock.isValid() || nextBlock.position() == currentBlock.position())
-        return false;
-
-    return nextBlock.text().trimmed().isEmpty();
-}
-
-QByteArray dummyTextForContext(CharacterContext context, bool closingBraceBlock)
-{
-    if (closingBraceBlock && context == CharacterContext::NewStatementOrContinuation)
-        return QByteArray();
-
-    switch (context) {
-    case CharacterContext::AfterComma:
-        return "a,";
-    case CharacterContext::LastAfterComma:
-        return "a";
-    case CharacterContext::IfOrElseWithoutScope:
-        return ";";
-    case CharacterContext::NewStatementOrContinuation:
-        return "/**/";
-    case CharacterContext::Unknown:
-    default:
-        QTC_ASSERT(false, return "";);
-    }
-}
-
-// Add extra text in case of the empty line or the line starting with ')'.
-// Track such extra pieces of text in isInsideDummyTextInLine().
-int forceIndentWithExtraText(QByteArray &buffer,
-                             CharacterContext &charContext,
-                             const QTextBlock &block,
-                             bool secondTry)
-{
-    if (!block.isValid())
-        return 0;
-
-    const QString blockText = block.text();
-    int firstNonWhitespace = Utils::indexOf(blockText,
-                                            [](const QChar &ch) { return !ch.isSpace(); });
-    int utf8Offset = Utils::Text::utf8NthLineOffset(block.document(),
-                                                    buffer,
-                                                    block.blockNumber() + 1);
-    if (firstNonWhitespace >= 0)
-        utf8Offset += firstNonWhitespace;
-    else
-        utf8Offset += blockText.length();
-
-    const bool closingParenBlock = firstNonWhitespace >= 0
-                                   && blockText.at(firstNonWhitespace) == ')';
-    const bool closingBraceBlock = firstNonWhitespace >= 0
-                                   && blockText.at(firstNonWhitespace) == '}';
-
-    int extraLength = 0;
-    QByteArray dummyText;
-    if (firstNonWhitespace < 0 && charContext != CharacterContext::Unknown
-        && nextBlockExistsAndEmpty(block)) {
-        // If the next line is also empty it's safer to use a comment line.
-        dummyText = "//";
-    } else if (firstNonWhitespace < 0 || closingParenBlock || closingBraceBlock) {
-        if (charContext == CharacterContext::LastAfterComma) {
-            charContext = CharacterContext::AfterComma;
-        } else if (charContext == CharacterContext::Unknown || firstNonWhitespace >= 0) {
-            QTextBlock lastBlock = reverseFindLastEmptyBlock(block);
-            if (lastBlock.position() > 0)
-                lastBlock = lastBlock.previous();
-
-            // If we don't know yet the dummy text, let's guess it and use for this line and before.
-            charContext = characterContext(block, lastBlock);
-        }
-
-        dummyText = dummyTextForContext(charContext, closingBraceBlock);
-    }
-
-    // A comment at the end of the line appears to prevent clang-format from removing line breaks.
-    if (dummyText == "/**/" || dummyText.isEmpty()) {
-        if (block.previous().isValid()) {
-            const int prevEndOffset = Utils::Text::utf8NthLineOffset(block.document(), buffer,
-                    block.blockNumber()) + block.previous().text().length();
-            buffer.insert(prevEndOffset, " //");
-            extraLength += 3;
-        }
-    }
-    buffer.insert(utf8Offset + extraLength, dummyText);
-    extraLength += dummyText.length();
-
-    if (secondTry) {
-        int nextLinePos = buffer.indexOf('\n', utf8Offset);
-        if (nextLinePos < 0)
-            nextLinePos = buffer.size() - 1;
-
-        if (nextLinePos > 0) {
-            // If first try was not successful try to put ')' in the end of the line to close possibly
-            // unclosed parenthesis.
-            // TODO: Does it help to add different endings depending on the context?
-            buffer.insert(nextLinePos, ')');
-            extraLength += 1;
-        }
-    }
-
-    return extraLength;
-}
-
-bool isInsideDummyTextInLine(const QString &originalLine, const QString &modifiedLine, int column)
-{
-    // Detect the cases when we have inserted extra text into the line to get the indentation.
-    return originalLine.length() < modifiedLine.length() && column != modifiedLine.length() + 1
-           && (column > originalLine.length() || originalLine.trimmed().isEmpty()
-               || !modifiedLine.startsWith(originalLine));
-}
-
-Utils::Text::Replacements utf16Replacements(const QTextDocument *doc,
-                                            const QByteArray &utf8Buffer,
-                                            const clang::tooling::Replacements &replacements)
-{
-    Utils::Text::Replacements convertedReplacements;
-    convertedReplacements.reserve(replacements.size());
-
-    for (const clang::tooling::Replacement &replacement : replacements) {
-        Utils::LineColumn lineColUtf16 = Utils::Text::utf16LineColumn(utf8Buffer,
-                                                                      static_cast<int>(
-                                                                          replacement.getOffset()));
-        if (!lineColUtf16.isValid())
-            continue;
-
-        const QString lineText = doc->findBlockByNumber(lineColUtf16.line - 1).text();
-        const QString bufferLineText
-            = Utils::Text::utf16LineTextInUtf8Buffer(utf8Buffer,
-                                                     static_cast<int>(replacement.getOffset()));
-        if (isInsideDummyTextInLine(lineText, bufferLineText, lineColUtf16.column))
-            continue;
-
-        lineColUtf16.column = std::min(lineColUtf16.column, int(lineText.length()) + 1);
-
-        const int utf16Offset = Utils::Text::positionInText(doc,
-                                                            lineColUtf16.line,
-                                                            lineColUtf16.column);
-        const int utf16Length = QString::fromUtf8(
-                                    utf8Buffer.mid(static_cast<int>(replacement.getOffset()),
-                                                   static_cast<int>(replacement.getLength())))
-                                    .size();
-        convertedReplacements.emplace_back(utf16Offset,
-                                           utf16Length,
-                                           QString::fromStdString(replacement.getReplacementText().str()));
-    }
-
-    return convertedReplacements;
-}
-
 QString selectedLines(QTextDocument *doc, const QTextBlock &startBlock, const QTextBlock &endBlock)
 {
     return Utils::Text::textAt(QTextCursor(doc),
@@ -424,22 +111,27 @@ int indentationForBlock(const Utils::Text::Replacements &toReplace,
 
 bool doNotIndentInContext(QTextDocument *doc, int pos)
 {
-    const QChar character = doc->characterAt(pos);
     const QTextBlock currentBlock = doc->findBlock(pos);
-    const QString text = currentBlock.text().left(pos - currentBlock.position());
+    const Internal::BlockText blockText(currentBlock);
+    const int column = pos - currentBlock.position();
+    const auto characterAt = [&blockText](int column) {
+        return column >= 0 && column < blockText.view().size()
+                   ? blockText.view().at(column)
+                   : QChar(QChar::ParagraphSeparator);
+    };
+    const QStringView text = blockText.left(column);
     // NOTE: check if "<<" and ">>" always work correctly.
-    switch (character.toLatin1()) {
+    switch (characterAt(column).toLatin1()) {
     default:
         break;
     case ':':
         // Do not indent when it's the first ':' and it's not the 'case' line.
-        if (text.contains(QLatin1String("case")) || text.contains(QLatin1String("default"))
-            || text.contains(QLatin1String("public")) || text.contains(QLatin1String("private"))
-            || text.contains(QLatin1String("protected")) || text.contains(QLatin1String("signals"))
-            || text.contains(QLatin1String("Q_SIGNALS"))) {
+        if (text.contains(u"case") || text.contains(u"default") || text.contains(u"public")
+            || text.contains(u"private") || text.contains(u"protected")
+            || text.contains(u"signals") || text.contains(u"Q_SIGNALS")) {
             return false;
         }
-        if (pos > 0 && doc->characterAt(pos - 1) != ':')
+        if (pos > 0 && characterAt(column - 1) != ':')
             return true;
         break;
     }
@@ -447,6 +139,62 @@ bool doNotIndentInContext(QTextDocument *doc, int pos)
     return false;
 }
 
+QString replacementsToKeepName(ReplacementsToKeep replacementsToKeep)
+{
+    switch (replacementsToKeep) {
+    case ReplacementsToKeep::OnlyIndent:
+        return QString("OnlyIndent");
+    case ReplacementsToKeep::IndentAndBefore:
+        return QString("IndentAndBefore");
+    case ReplacementsToKeep::All:
+        return QString("All");
+    }
+    return {};
+}
+
+std::string_view utf8View(const QByteArray &buffer)
+{
+    return std::string_view(buffer.constData(), size_t(buffer.size()));
+}
+
+std::vector<clang::tooling::Range> clangRanges(const std::vector<Utf8Range> &ranges)
+{
+    return Utils::transform<std::vector>(ranges, [](const Utf8Range &range) {
+        return clang::tooling::Range(unsigned(range.offset), unsigned(range.length));
+    });
+}
+
+bool isSlowRequest(qint64 elapsedMs)
+{
+    const int threshold = ClangFormatSettings::instance().slowRequestThreshold();
+    return threshold > 0 && elapsedMs >= threshold;
+}
+
+// Older slow requests are removed, a document that stays slow must not fill the disk.
+const int maxSlowRequestBundles = 20;
+const qint64 maxSlowRequestBytes = 64 * 1024 * 1024;
+
+// Saves the inputs of a slow request, so that it can be replayed with clangformatreplay.
+// Writing the files must not make the slow request any slower, so it happens in the background.
+void captureSlowRequest(const ReproBundle &bundle)
+{
+    const Utils::FilePath directory = Core::ICore::userResourcePath() / "clang-format"
+                                      / "slow-requests";
+    ExtensionSystem::PluginManager::futureSynchronizer()->addFuture(
+        Utils::asyncRun([bundle, directory] {
+            const Utils::expected_str<Utils::FilePath> bundleDirectory
+                = writeReproBundle(bundle, directory);
+            if (!bundleDirectory) {
+                qCWarning(clangIndenterLog)
+                    << "Cannot save slow request:" << bundleDirectory.error();
+                return;
+            }
+            qCDebug(clangIndenterLog) << "Request took" << bundle.totalMs << "ms, saved to"
+                                      << bundleDirectory->toUserOutput();
+            removeOldReproBundles(directory, maxSlowRequestBundles, maxSlowRequestBytes);
+        }));
+}
+
 int formattingRangeStart(const QTextBlock &currentBlock,
                          const QByteArray &buffer,
                          int documentRevision)
@@ -464,9 +212,277 @@ int formattingRangeStart(const QTextBlock &currentBlock,
 }
 } // namespace
 
+// The result of the last indentation query without a typed character. Enter makes the editor
+// ask for the indentation of the same lines several times before the event loop runs again,
+// these queries share one reformat() as long as the document revision did not change.
+struct ClangFormatBaseIndenter::CoalescedIndentation
+{
+    int revision = -1;
+    int firstBlockNumber = -1;
+    int lastBlockNumber = -1;
+    QByteArray buffer;
+    Utils::Text::Replacements replacements;
+};
+
+// The lines in front of which code still has to be formatted after ';' or '}' was typed.
+// The cursors move with the edits, the timer restarts on every change of the document.
+struct ClangFormatBaseIndenter::DeferredFormatting
+{
+    QTextCursor start;
+    QTextCursor end;
+    QTimer timer;
+};
+
 ClangFormatBaseIndenter::ClangFormatBaseIndenter(QTextDocument *doc)
     : TextEditor::Indenter(doc)
-{}
+{
+    // The coalesced indentation is dropped at the end of each event loop turn, the native
+    // engine keeps its block states as long as the document is open.
+    Memory::addCache(this, "Native indentation states", [this]() -> qint64 {
+        return m_nativeIndentationEngine ? qint64(m_nativeIndentationEngine->memoryBytes()) : 0;
+    });
+    DocumentStateBudget::instance().add(this,
+                                        [this] { return cachedStateBytes(); },
+                                        [this] { releaseCachedState(); });
+}
+
+ClangFormatBaseIndenter::~ClangFormatBaseIndenter()
+{
+    DocumentStateBudget::instance().remove(this);
+    Memory::removeCache(this);
+}
+
+void ClangFormatBaseIndenter::markRecentlyUsed()
+{
+    DocumentStateBudget::instance().touch(this);
+}
+
+qint64 ClangFormatBaseIndenter::cachedStateBytes() const
+{
+    qint64 bytes = m_nativeIndentationEngine ? qint64(m_nativeIndentationEngine->memoryBytes())
+                                             : 0;
+    if (const CoalescedIndentation *coalesced = m_coalescedIndentation.get()) {
+        bytes += coalesced->buffer.capacity();
+        for (const Utils::Text::Replacement &replacement : coalesced->replacements)
+            bytes += sizeof(replacement) + replacement.text.capacity() * sizeof(QChar);
+    }
+    return bytes;
+}
+
+void ClangFormatBaseIndenter::releaseCachedState()
+{
+    // Pending deferred formatting is work, not a cache, and stays.
+    m_nativeIndentationEngine.reset();
+    m_coalescedIndentation.reset();
+}
+
+NativeIndentationEngine *ClangFormatBaseIndenter::nativeIndentationEngine(const QChar &typedChar)
+{
+    if (ClangFormatSettings::instance().indentationEngine()
+        == ClangFormatSettings::ClangFormatEngine) {
+        return nullptr;
+    }
+    // Formatting while typing needs clang-format for the code before the cursor.
+    if (formatWhileTyping() && (typedChar == ';' || typedChar == '}'))
+        return nullptr;
+
+    if (!m_nativeIndentationEngine) {
+        m_nativeIndentationEngine = std::make_unique<NativeIndentationEngine>(m_doc);
+        m_nativeEngineStyleGeneration = -1;
+    }
+    // Resolving the style looks for .clang-format files, too slow for every typed character.
+    if (m_nativeEngineFileName != m_fileName
+        || m_nativeEngineStyleGeneration != styleGeneration()) {
+        m_nativeIndentationEngine->setStyle(styleForFile());
+        m_nativeEngineFileName = m_fileName;
+        m_nativeEngineStyleGeneration = styleGeneration();
+    }
+    return m_nativeIndentationEngine.get();
+}
+
+// Returns -1 if the native engine is not used or cannot judge the line.
+int ClangFormatBaseIndenter::nativeIndentFor(const QTextBlock &block,
+                                             const QChar &typedChar,
+                                             int cursorPositionInEditor)
+{
+    Benchmark::firstIndentRequested();
+    NativeIndentationEngine *engine = nativeIndentationEngine(typedChar);
+    if (!engine)
+        return -1;
+    // Let the regular path decide whether to indent at all.
+    if (typedChar != QChar::Null && cursorPositionInEditor > 0
+        && m_doc->characterAt(cursorPositionInEditor - 1) == typedChar
+        && doNotIndentInContext(m_doc, cursorPositionInEditor - 1)) {
+        return -1;
+    }
+    const int indentation = engine->indentFor(block);
+    if (indentation >= 0)
+        Benchmark::firstIndentFinished();
+    return indentation;
+}
+
+void ClangFormatBaseIndenter::verifyNativeIndentation(const QTextBlock &block, int indentation)
+{
+    if (ClangFormatSettings::instance().indentationEngine()
+        != ClangFormatSettings::NativeEngineVerified) {
+        return;
+    }
+
+    // Only the snapshot is taken here, clang-format runs in the background.
+    const auto clangFormatIndentation = [this](const QTextBlock &current) {
+        const QTextBlock start = Internal::reverseFindLastEmptyBlock(current);
+        QByteArray buffer = Internal::documentBuffer(m_doc);
+        const int utf8Offset = Utils::Text::utf8NthLineOffset(m_doc,
+                                                              buffer,
+                                                              start.blockNumber() + 1);
+        const int utf8Length = selectedLines(m_doc, start, current).toUtf8().size()
+                               + Internal::addIndentationDummyText(buffer, start, current, false);
+        const int lineOffset = Utils::Text::utf8NthLineOffset(m_doc,
+                                                              buffer,
+                                                              current.blockNumber() + 1);
+        // Without a replacement, clang-format keeps the current indentation.
+        const QString text = current.text();
+        const int currentIndentation = int(
+            std::distance(text.begin(), std::find_if_not(text.begin(), text.end(), [](QChar ch) {
+                              return ch.isSpace();
+                          })));
+
+        QFuture<int> future = Utils::asyncRun([buffer,
+                                               style = styleForFile(),
+                                               fileName = m_fileName,
+                                               lines = Utf8Range{utf8Offset, utf8Length},
+                                               lineOffset,
+                                               currentIndentation] {
+            const Utf8Replacements toReplace = indentBuffer(utf8View(buffer),
+                                                            style,
+                                                            fileName,
+                                                            lines,
+                                                            ReplacementsToKeep::OnlyIndent);
+            if (toReplace.empty())
+                return -1; // clang-format could not complete
+            const auto replacement = std::find_if(toReplace.begin(),
+                                                  toReplace.end(),
+                                                  [lineOffset](const Utf8Replacement &replacement) {
+                                                      return replacement.offset == lineOffset - 1;
+                                                  });
+            if (replacement == toReplace.end())
+                return currentIndentation;
+            const std::size_t lineBreak = replacement->text.rfind('\n');
+            return int(replacement->text.size()
+                       - (lineBreak == std::string::npos ? 0 : lineBreak + 1));
+        });
+        ExtensionSystem::PluginManager::futureSynchronizer()->addFuture(future);
+        return future;
+    };
+    m_nativeIndentationEngine->scheduleVerification(block, indentation, clangFormatIndentation);
+}
+
+// The replacements for the lines of [startBlock..endBlock] if an earlier query of this
+// revision covered them. Replacements of other lines are dropped, indenting the lines of a
+// sub-range must not touch the rest.
+std::optional<Utils::Text::Replacements> ClangFormatBaseIndenter::coalescedReplacements(
+    const QTextBlock &startBlock, const QTextBlock &endBlock) const
+{
+    const CoalescedIndentation *coalesced = m_coalescedIndentation.get();
+    if (!coalesced || coalesced->revision != m_doc->revision())
+        return std::nullopt;
+    // Like an uncached query, which indents from the last empty block on.
+    const int first = Internal::reverseFindLastEmptyBlock(startBlock).blockNumber();
+    const int last = endBlock.blockNumber();
+    if (first < coalesced->firstBlockNumber || last > coalesced->lastBlockNumber)
+        return std::nullopt;
+    if (first == coalesced->firstBlockNumber && last == coalesced->lastBlockNumber)
+        return coalesced->replacements;
+
+    // A replacement of the indentation ends at the first character of its line.
+    return Utils::filtered(coalesced->replacements,
+                           [this, first, last](const Utils::Text::Replacement &replacement) {
+                               const int blockNumber
+                                   = m_doc->findBlock(replacement.offset + replacement.length)
+                                         .blockNumber();
+                               return blockNumber >= first && blockNumber <= last;
+                           });
+}
+
+void ClangFormatBaseIndenter::storeCoalescedIndentation(
+    const QTextBlock &startBlock,
+    const QTextBlock &endBlock,
+    const QByteArray &buffer,
+    const Utils::Text::Replacements &replacements)
+{
+    const bool scheduleReset = !m_coalescedIndentation;
+    if (scheduleReset)
+        m_coalescedIndentation = std::make_shared<CoalescedIndentation>();
+    *m_coalescedIndentation = {m_doc->revision(),
+                               startBlock.blockNumber(),
+                               endBlock.blockNumber(),
+                               buffer,
+                               replacements};
+    if (!scheduleReset)
+        return;
+
+    // Only queries of the same event loop turn are merged, settings or the style might
+    // change in between otherwise.
+    QTimer::singleShot(0, m_doc, [this, coalesced = std::weak_ptr(m_coalescedIndentation)] {
+        if (!coalesced.expired())
+            m_coalescedIndentation.reset();
+    });
+}
+
+void ClangFormatBaseIndenter::deferFormatting(const QTextBlock &startBlock,
+                                              const QTextBlock &endBlock)
+{
+    if (!m_deferredFormatting) {
+        m_deferredFormatting = std::make_unique<DeferredFormatting>();
+        QTimer &timer = m_deferredFormatting->timer;
+        timer.setSingleShot(true);
+        QObject::connect(&timer, &QTimer::timeout, [this] { formatDeferred(); });
+        QObject::connect(m_doc, &QTextDocument::contentsChanged, &timer, [&timer] {
+            if (timer.isActive())
+                timer.start();
+        });
+    }
+
+    DeferredFormatting &deferred = *m_deferredFormatting;
+    if (deferred.start.isNull() || startBlock.position() < deferred.start.position())
+        deferred.start = QTextCursor(startBlock);
+    const int endPosition = endBlock.position() + endBlock.length() - 1;
+    if (deferred.end.isNull() || endPosition > deferred.end.position()) {
+        deferred.end = QTextCursor(m_doc);
+        deferred.end.setPosition(endPosition);
+    }
+    deferred.timer.start(formatWhileTypingDelay());
+}
+
+// Formats the code in front of all statements that were completed since the editor was idle
+// the last time, in one reformat() call.
+void ClangFormatBaseIndenter::formatDeferred()
+{
+    DeferredFormatting &deferred = *m_deferredFormatting;
+    const QTextBlock startBlock = m_doc->findBlock(deferred.start.position());
+    const QTextBlock endBlock = m_doc->findBlock(deferred.end.position());
+    deferred.start = QTextCursor();
+    deferred.end = QTextCursor();
+    if (!formatWhileTyping() || !startBlock.isValid() || !endBlock.isValid())
+        return;
+
+    const QByteArray buffer = Internal::documentBuffer(m_doc);
+    applyReplacements(m_doc,
+                      replacements(buffer,
+                                    startBlock,
+                                    endBlock,
+                                    -1,
+                                    ReplacementsToKeep::IndentAndBefore,
+                                    QChar::Null));
+}
+
+QByteArray ClangFormatBaseIndenter::indentationBuffer() const
+{
+    const CoalescedIndentation *coalesced = m_coalescedIndentation.get();
+    if (coalesced && coalesced->revision == m_doc->revision())
+        return coalesced->buffer;
+    return Internal::documentBuffer(m_doc);
+}
 
 Utils::Text::Replacements ClangFormatBaseIndenter::replacements(QByteArray buffer,
                                                                 const QTextBlock &startBlock,
@@ -477,50 +493,64 @@ Utils::Text::Replacements ClangFormatBaseIndenter::replacements(QByteArray buffe
                                                                 bool secondTry) const
 {
     QTC_ASSERT(replacementsToKeep != ReplacementsToKeep::All, return Utils::Text::Replacements());
+    Benchmark::firstIndentRequested();
 
-    clang::format::FormatStyle style = styleForFile();
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    const clang::format::FormatStyle style = styleForFile();
     QByteArray originalBuffer = buffer;
 
     int utf8Offset = Utils::Text::utf8NthLineOffset(m_doc, buffer, startBlock.blockNumber() + 1);
     QTC_ASSERT(utf8Offset >= 0, return Utils::Text::Replacements(););
     int utf8Length = selectedLines(m_doc, startBlock, endBlock).toUtf8().size();
 
-    int rangeStart = 0;
-    if (replacementsToKeep == ReplacementsToKeep::IndentAndBefore)
-        rangeStart = formattingRangeStart(startBlock, buffer, lastSaveRevision());
-
-    adjustFormatStyleForLineBreak(style, replacementsToKeep);
-    if (replacementsToKeep == ReplacementsToKeep::OnlyIndent) {
-        CharacterContext currentCharContext = CharacterContext::Unknown;
-        // Iterate backwards to reuse the same dummy text for all empty lines.
-        for (int index = endBlock.blockNumber(); index >= startBlock.blockNumber(); --index) {
-            utf8Length += forceIndentWithExtraText(buffer,
-                                                   currentCharContext,
-                                                   m_doc->findBlockByNumber(index),
-                                                   secondTry);
-        }
+    const int formatFrom = replacementsToKeep == ReplacementsToKeep::IndentAndBefore
+                               ? formattingRangeStart(startBlock, buffer, lastSaveRevision())
+                               : -1;
+
+    if (replacementsToKeep == ReplacementsToKeep::OnlyIndent)
+        utf8Length += Internal::addIndentationDummyText(buffer, startBlock, endBlock, secondTry);
+
+    QElapsedTimer reformatTimer;
+    reformatTimer.start();
+    const Utf8Replacements filtered = indentBuffer(utf8View(buffer),
+                                                   style,
+                                                   m_fileName,
+                                                   {utf8Offset, utf8Length},
+                                                   replacementsToKeep,
+                                                   formatFrom);
+    const qint64 reformatMs = reformatTimer.elapsed();
+    if (ClangFormatSettings::instance().calibrateFileSizeThreshold()) {
+        FileSizeCalibration::instance().recordReformat(m_fileName,
+                                                       style,
+                                                       buffer.size(),
+                                                       reformatTimer.nsecsElapsed());
     }
 
-    if (replacementsToKeep != ReplacementsToKeep::IndentAndBefore || utf8Offset < rangeStart)
-        rangeStart = utf8Offset;
-
-    unsigned int rangeLength = static_cast<unsigned int>(utf8Offset + utf8Length - rangeStart);
-    std::vector<clang::tooling::Range> ranges{{static_cast<unsigned int>(rangeStart), rangeLength}};
-
-    clang::format::FormattingAttemptStatus status;
-    clang::tooling::Replacements clangReplacements = reformat(style,
-                                                              buffer.data(),
-                                                              ranges,
-                                                              m_fileName.toString().toStdString(),
-                                                              &status);
-
-    clang::tooling::Replacements filtered;
-    if (status.FormatComplete) {
-        filtered = filteredReplacements(buffer,
-                                        clangReplacements,
-                                        utf8Offset,
-                                        utf8Length,
-                                        replacementsToKeep);
+    // Recorded before a second try, so that each try counts on its own.
+    Statistics::recordIndentation(m_doc,
+                                  m_fileName,
+                                  replacementsToKeep,
+                                  totalTimer.nsecsElapsed(),
+                                  buffer.size(),
+                                  secondTry);
+
+    // Checked before a second try. Only the first slow request of a document revision is
+    // captured, the second try and the queries for the other lines of the same edit repeat it.
+    if (isSlowRequest(totalTimer.elapsed()) && m_slowRequestRevision != m_doc->revision()) {
+        m_slowRequestRevision = m_doc->revision();
+        const int rangeStart = formatFrom >= 0 ? std::min(formatFrom, utf8Offset) : utf8Offset;
+        captureSlowRequest({buffer,
+                            clang::format::configurationAsText(
+                                indentationStyle(style, replacementsToKeep)),
+                            clangRanges({{rangeStart, utf8Offset + utf8Length - rangeStart}}),
+                            m_fileName.toString(),
+                            replacementsToKeepName(replacementsToKeep),
+                            typedChar == QChar::Null ? QString() : QString(typedChar),
+                            secondTry,
+                            totalTimer.elapsed(),
+                            reformatMs});
     }
     const bool canTryAgain = replacementsToKeep == ReplacementsToKeep::OnlyIndent
                              && typedChar == QChar::Null && !secondTry;
@@ -534,17 +564,36 @@ Utils::Text::Replacements ClangFormatBaseIndenter::replacements(QByteArray buffe
                             true);
     }
 
-    return utf16Replacements(m_doc, buffer, filtered);
+    const Utils::Text::Replacements toReplace = Internal::utf16Replacements(m_doc,
+                                                                            buffer,
+                                                                            filtered);
+    Benchmark::firstIndentFinished();
+    return toReplace;
 }
 
+// Applying this many replacements at once takes long enough to drop frames.
+const std::size_t slicedReplacementsThreshold = 5000;
+
 Utils::Text::Replacements ClangFormatBaseIndenter::format(
-    const TextEditor::RangesInLines &rangesInLines)
+    const TextEditor::RangesInLines &requestedRanges, FormattingMode mode)
 {
+    // Saving passes the lines edited since the last save, the settings may ask for others.
+    const TextEditor::RangesInLines rangesInLines = mode == FormattingMode::Settings
+                                                        ? rangesToFormatOnSave(requestedRanges)
+                                                        : requestedRanges;
     if (rangesInLines.empty())
         return Utils::Text::Replacements();
 
-    const QByteArray buffer = m_doc->toPlainText().toUtf8();
-    std::vector<clang::tooling::Range> ranges;
+    Benchmark::firstIndentRequested();
+    // The buffer has to be the document with the previous result applied completely.
+    finishApplyingReplacements(m_doc);
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    const QByteArray buffer = Internal::documentBuffer(m_doc);
+    const int revision = m_doc->revision();
+    std::vector<Utf8Range> ranges;
     ranges.reserve(rangesInLines.size());
 
     for (auto &range : rangesInLines) {
@@ -554,33 +603,46 @@ Utils::Text::Replacements ClangFormatBaseIndenter::format(
             utf8RangeLength += Utils::Text::utf8NthLineOffset(m_doc, buffer, range.endLine)
                                - utf8StartOffset;
         }
-        ranges.emplace_back(static_cast<unsigned int>(utf8StartOffset),
-                            static_cast<unsigned int>(utf8RangeLength));
+        ranges.push_back({utf8StartOffset, utf8RangeLength});
     }
 
-    clang::format::FormatStyle style = styleForFile();
-    const std::string assumedFileName = m_fileName.toString().toStdString();
-    clang::tooling::Replacements clangReplacements = clang::format::sortIncludes(style,
-                                                                                 buffer.data(),
-                                                                                 ranges,
-                                                                                 assumedFileName);
-    auto changedCode = clang::tooling::applyAllReplacements(buffer.data(), clangReplacements);
-    QTC_ASSERT(changedCode, {
-        qDebug() << QString::fromStdString(llvm::toString(changedCode.takeError()));
-        return Utils::Text::Replacements();
-    });
-    ranges = clang::tooling::calculateRangesAfterReplacements(clangReplacements, ranges);
-
-    clang::format::FormattingAttemptStatus status;
-    const clang::tooling::Replacements formatReplacements = reformat(style,
-                                                                     *changedCode,
-                                                                     ranges,
-                                                                     assumedFileName,
-                                                                     &status);
-    clangReplacements = clangReplacements.merge(formatReplacements);
-
-    const Utils::Text::Replacements toReplace = utf16Replacements(m_doc, buffer, clangReplacements);
-    Utils::Text::applyReplacements(m_doc, toReplace);
+    const clang::format::FormatStyle style = styleForFile();
+    QElapsedTimer reformatTimer;
+    reformatTimer.start();
+    const Utf8Replacements utf8Replacements = formatBuffer(utf8View(buffer),
+                                                           style,
+                                                           m_fileName,
+                                                           ranges);
+    const qint64 reformatMs = reformatTimer.elapsed();
+
+    const Utils::Text::Replacements toReplace = Internal::utf16Replacements(m_doc,
+                                                                            buffer,
+                                                                            utf8Replacements);
+    // Saving writes the document right after this returns, it has to be complete.
+    if (mode == FormattingMode::Forced && ClangFormatSettings::instance().applyFormattingInSlices()
+        && toReplace.size() >= slicedReplacementsThreshold) {
+        applyReplacementsInSlices(m_doc,
+                                  toReplace,
+                                  Tr::tr("Formatting %1").arg(m_fileName.fileName()));
+    } else {
+        Utils::Text::applyReplacements(m_doc, toReplace);
+    }
+    Statistics::recordFormatting(m_doc, m_fileName, totalTimer.nsecsElapsed(), buffer.size());
+    Benchmark::firstIndentFinished();
+
+    // The replacements are applied already, the request was for the revision before.
+    if (isSlowRequest(totalTimer.elapsed()) && m_slowRequestRevision != revision) {
+        m_slowRequestRevision = revision;
+        captureSlowRequest({buffer,
+                            clang::format::configurationAsText(style),
+                            clangRanges(ranges),
+                            m_fileName.toString(),
+                            replacementsToKeepName(ReplacementsToKeep::All),
+                            QString(),
+                            false,
+                            totalTimer.elapsed(),
+                            reformatMs});
+    }
 
     return toReplace;
 }
@@ -596,7 +658,15 @@ Utils::Text::Replacements ClangFormatBaseIndenter::indentsFor(QTextBlock startBl
         return Utils::Text::Replacements();
     }
 
-    startBlock = reverseFindLastEmptyBlock(startBlock);
+    if (typedChar == QChar::Null) {
+        if (std::optional<Utils::Text::Replacements> coalesced
+            = coalescedReplacements(startBlock, endBlock)) {
+            Benchmark::indentationCoalesced();
+            return *coalesced;
+        }
+    }
+
+    startBlock = Internal::reverseFindLastEmptyBlock(startBlock);
     const int startBlockPosition = startBlock.position();
     if (startBlockPosition > 0) {
         trimRHSWhitespace(startBlock.previous());
@@ -604,7 +674,7 @@ Utils::Text::Replacements ClangFormatBaseIndenter::indentsFor(QTextBlock startBl
             cursorPositionInEditor += startBlock.position() - startBlockPosition;
     }
 
-    const QByteArray buffer = m_doc->toPlainText().toUtf8();
+    const QByteArray buffer = Internal::documentBuffer(m_doc);
 
     ReplacementsToKeep replacementsToKeep = ReplacementsToKeep::OnlyIndent;
     if (formatWhileTyping()
@@ -616,15 +686,22 @@ Utils::Text::Replacements ClangFormatBaseIndenter::indentsFor(QTextBlock startBl
         // cursorPositionInEditor == -1 means the condition matches automatically.
 
         // Format only before complete statement not to break code.
-        replacementsToKeep = ReplacementsToKeep::IndentAndBefore;
+        if (formatWhileTypingDelay() > 0)
+            deferFormatting(startBlock, endBlock);
+        else
+            replacementsToKeep = ReplacementsToKeep::IndentAndBefore;
     }
 
-    return replacements(buffer,
-                        startBlock,
-                        endBlock,
-                        cursorPositionInEditor,
-                        replacementsToKeep,
-                        typedChar);
+    const Utils::Text::Replacements toReplace = replacements(buffer,
+                                                             startBlock,
+                                                             endBlock,
+                                                             cursorPositionInEditor,
+                                                             replacementsToKeep,
+                                                             typedChar);
+    Benchmark::indentationComputed();
+    if (typedChar == QChar::Null)
+        storeCoalescedIndentation(startBlock, endBlock, buffer, toReplace);
+    return toReplace;
 }
 
 void ClangFormatBaseIndenter::indentBlocks(const QTextBlock &startBlock,
@@ -669,13 +746,36 @@ void ClangFormatBaseIndenter::indentBlock(const QTextBlock &block,
                                           const TextEditor::TabSettings & /*tabSettings*/,
                                           int cursorPositionInEditor)
 {
-    indentBlocks(block, block, typedChar, cursorPositionInEditor);
+    const int nativeIndentation = nativeIndentFor(block, typedChar, cursorPositionInEditor);
+    if (nativeIndentation < 0) {
+        indentBlocks(block, block, typedChar, cursorPositionInEditor);
+        return;
+    }
+
+    const QString indentation = m_nativeIndentationEngine->indentationString(nativeIndentation);
+    const QString text = block.text();
+    const int leadingSpaces = int(std::distance(
+        text.begin(), std::find_if_not(text.begin(), text.end(), [](QChar ch) {
+            return ch.isSpace();
+        })));
+    if (QStringView(text).left(leadingSpaces) != indentation) {
+        QTextCursor cursor(block);
+        cursor.setPosition(block.position() + leadingSpaces, QTextCursor::KeepAnchor);
+        cursor.insertText(indentation);
+    }
+    verifyNativeIndentation(block, nativeIndentation);
 }
 
 int ClangFormatBaseIndenter::indentFor(const QTextBlock &block,
                                        const TextEditor::TabSettings & /*tabSettings*/,
                                        int cursorPositionInEditor)
 {
+    const int nativeIndentation = nativeIndentFor(block, QChar::Null, cursorPositionInEditor);
+    if (nativeIndentation >= 0) {
+        verifyNativeIndentation(block, nativeIndentation);
+        return nativeIndentation;
+    }
+
     Utils::Text::Replacements toReplace = indentsFor(block,
                                                      block,
                                                      QChar::Null,
@@ -683,8 +783,7 @@ int ClangFormatBaseIndenter::indentFor(const QTextBlock &block,
     if (toReplace.empty())
         return -1;
 
-    const QByteArray buffer = m_doc->toPlainText().toUtf8();
-    return indentationForBlock(toReplace, buffer, block);
+    return indentationForBlock(toReplace, indentationBuffer(), block);
 }
 
 TextEditor::IndentationForBlock ClangFormatBaseIndenter::indentationForBlocks(
@@ -700,7 +799,7 @@ TextEditor::IndentationForBlock ClangFormatBaseIndenter::indentationForBlocks(
                                                      QChar::Null,
                                                      cursorPositionInEditor);
 
-    const QByteArray buffer = m_doc->toPlainText().toUtf8();
+    const QByteArray buffer = indentationBuffer();
     for (const QTextBlock &block : blocks)
         ret.insert(block.blockNumber(), indentationForBlock(toReplace, buffer, block));
     return ret;
@@ -749,47 +848,7 @@ void ClangFormatBaseIndenter::autoIndent(const QTextCursor &cursor,
 
 clang::format::FormatStyle ClangFormatBaseIndenter::styleForFile() const
 {
-    llvm::Expected<clang::format::FormatStyle> styleFromProjectFolder
-        = clang::format::getStyle("file", m_fileName.path().toStdString(), "none");
-
-    const ProjectExplorer::Project *projectForFile
-        = ProjectExplorer::SessionManager::projectForFile(m_fileName);
-    const bool overrideStyleFile
-        = projectForFile ? projectForFile->namedSettings(Constants::OVERRIDE_FILE_ID).toBool()
-                         : ClangFormatSettings::instance().overrideDefaultFile();
-    const TextEditor::ICodeStylePreferences *preferences
-        = projectForFile
-              ? projectForFile->editorConfiguration()->codeStyle("Cpp")->currentPreferences()
-              : TextEditor::TextEditorSettings::codeStyle("Cpp")->currentPreferences();
-
-    if (overrideStyleFile || !styleFromProjectFolder
-        || *styleFromProjectFolder == clang::format::getNoStyle()) {
-        Utils::FilePath filePath = filePathToCurrentSettings(preferences);
-
-        if (!filePath.exists())
-            return qtcStyle();
-
-        clang::format::FormatStyle currentSettingsStyle;
-        currentSettingsStyle.Language = clang::format::FormatStyle::LK_Cpp;
-        const std::error_code error
-            = clang::format::parseConfiguration(filePath.fileContents().toStdString(),
-                                                &currentSettingsStyle);
-        QTC_ASSERT(error.value() == static_cast<int>(clang::format::ParseError::Success),
-                   return qtcStyle());
-
-        return currentSettingsStyle;
-    }
-
-    if (styleFromProjectFolder) {
-        addQtcStatementMacros(*styleFromProjectFolder);
-        return *styleFromProjectFolder;
-    }
-
-    handleAllErrors(styleFromProjectFolder.takeError(), [](const llvm::ErrorInfoBase &) {
-        // do nothing
-    });
-
-    return qtcStyle();
+    return formatStyleForFile(m_fileName);
 }
 
 } // namespace ClangFormat
@@ -7,12 +7,16 @@
 
 #include <QLoggingCategory>
 
+#include <memory>
+
 namespace clang::format { struct FormatStyle; }
 
 namespace ClangFormat {
 
 Q_DECLARE_LOGGING_CATEGORY(clangIndenterLog)
 
+class NativeIndentationEngine;
+
 class ClangFormatBaseIndenter : public TextEditor::Indenter
 {
 public:
@@ -55,14 +59,51 @@ public:
     void setOverriddenPreferences(TextEditor::ICodeStylePreferences *preferences) final;
     void setOverriddenStyle(const clang::format::FormatStyle &style);
 
+    // Keeps the caches of recently used documents, see DocumentStateBudget.
+    void markRecentlyUsed();
+
 protected:
     virtual bool formatCodeInsteadOfIndent() const { return false; }
     virtual bool formatWhileTyping() const { return false; }
+    virtual int formatWhileTypingDelay() const { return 0; }
     virtual int lastSaveRevision() const { return 0; }
+    // What the document caches beyond its text. Released caches are rebuilt on the next use.
+    virtual qint64 cachedStateBytes() const;
+    virtual void releaseCachedState();
+    virtual TextEditor::RangesInLines rangesToFormatOnSave(
+        const TextEditor::RangesInLines &editedRanges)
+    {
+        return editedRanges;
+    }
 
 private:
+    NativeIndentationEngine *nativeIndentationEngine(const QChar &typedChar);
+    int nativeIndentFor(const QTextBlock &block, const QChar &typedChar, int cursorPositionInEditor);
+    void verifyNativeIndentation(const QTextBlock &block, int indentation);
+
+    struct CoalescedIndentation;
+    std::optional<Utils::Text::Replacements> coalescedReplacements(
+        const QTextBlock &startBlock, const QTextBlock &endBlock) const;
+    void storeCoalescedIndentation(const QTextBlock &startBlock,
+                                   const QTextBlock &endBlock,
+                                   const QByteArray &buffer,
+                                   const Utils::Text::Replacements &replacements);
+    QByteArray indentationBuffer() const;
+
+    struct DeferredFormatting;
+    void deferFormatting(const QTextBlock &startBlock, const QTextBlock &endBlock);
+    void formatDeferred();
+
     friend class ClangFormatBaseIndenterPrivate;
     class ClangFormatBaseIndenterPrivate *d = nullptr;
+    std::unique_ptr<NativeIndentationEngine> m_nativeIndentationEngine;
+    // What the style of the native engine was resolved for, see styleGeneration().
+    Utils::FilePath m_nativeEngineFileName;
+    int m_nativeEngineStyleGeneration = -1;
+    std::shared_ptr<CoalescedIndentation> m_coalescedIndentation;
+    std::unique_ptr<DeferredFormatting> m_deferredFormatting;
+    // The document revision of the last captured slow request.
+    mutable int m_slowRequestRevision = -1;
 };
 
 } // namespace ClangFormat
@@ -0,0 +1,243 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatbatch.h"
+
+#include "clangformatbaseindenter.h"
+#include "clangformatformatter.h"
+#include "clangformatindentationbuffer.h"
+#include "clangformatreplacementapplier.h"
+#include "clangformatsettings.h"
+#include "clangformatstatistics.h"
+#include "clangformatutils.h"
+
+#include <extensionsystem/pluginmanager.h>
+
+#include <texteditor/textdocument.h>
+
+#include <utils/async.h>
+#include <utils/futuresynchronizer.h>
+#include <utils/qtcassert.h>
+#include <utils/textutils.h>
+
+#include <QElapsedTimer>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace ClangFormat {
+
+namespace {
+// A document that is edited while its result is computed is formatted again this often, then
+// synchronously by its indenter.
+const int maxRetries = 2;
+
+// Sorts the ranges and merges overlapping and adjacent ones.
+TextEditor::RangesInLines unitedRanges(TextEditor::RangesInLines ranges)
+{
+    std::sort(ranges.begin(), ranges.end(), [](const auto &left, const auto &right) {
+        return left.startLine < right.startLine;
+    });
+    TextEditor::RangesInLines united;
+    for (const TextEditor::RangeInLines &range : ranges) {
+        if (!united.empty() && range.startLine <= united.back().endLine + 1)
+            united.back().endLine = std::max(united.back().endLine, range.endLine);
+        else
+            united.push_back(range);
+    }
+    return united;
+}
+
+// A range of lines that moves with the edits of the document.
+struct TrackedRange
+{
+    QTextCursor start;
+    QTextCursor end;
+};
+
+TextEditor::RangesInLines rangesInLines(const std::vector<TrackedRange> &ranges)
+{
+    TextEditor::RangesInLines result;
+    for (const TrackedRange &range : ranges)
+        result.push_back({range.start.blockNumber() + 1, range.end.blockNumber() + 1});
+    return unitedRanges(result);
+}
+
+// Like ClangFormatBaseIndenter::format(), whole lines from the start of the first one to the
+// end of the last one.
+std::vector<Utf8Range> utf8Ranges(const QTextDocument *doc,
+                                  const QByteArray &buffer,
+                                  const TextEditor::RangesInLines &ranges)
+{
+    std::vector<Utf8Range> result;
+    result.reserve(ranges.size());
+    for (const TextEditor::RangeInLines &range : ranges) {
+        const int startOffset = Utils::Text::utf8NthLineOffset(doc, buffer, range.startLine);
+        int length = doc->findBlockByNumber(range.endLine - 1).text().toUtf8().size();
+        if (range.endLine > range.startLine)
+            length += Utils::Text::utf8NthLineOffset(doc, buffer, range.endLine) - startOffset;
+        result.push_back({startOffset, length});
+    }
+    return result;
+}
+} // namespace
+
+// Runs formatBuffer() on snapshots of the documents of a committed batch in parallel, applies
+// the results in the main thread and deletes itself. A result is only applied to the revision
+// of the document it was computed for.
+class FormattingBatch::Runner final : public QObject
+{
+public:
+    Runner(const std::vector<Document> &documents, const std::function<void(int)> &done)
+        : m_done(done)
+    {
+        for (const Document &entry : documents) {
+            if (!entry.document)
+                continue;
+            QTextDocument *doc = entry.document->document();
+            Job job{entry.document, {}};
+            for (const TextEditor::RangeInLines &range : unitedRanges(entry.ranges)) {
+                const QTextBlock startBlock = doc->findBlockByNumber(range.startLine - 1);
+                QTextBlock endBlock = doc->findBlockByNumber(range.endLine - 1);
+                if (!startBlock.isValid())
+                    continue;
+                if (!endBlock.isValid())
+                    endBlock = doc->lastBlock();
+                QTextCursor end(endBlock);
+                end.movePosition(QTextCursor::EndOfBlock);
+                job.ranges.push_back({QTextCursor(startBlock), end});
+            }
+            if (!job.ranges.empty())
+                m_jobs.push_back(std::move(job));
+        }
+        m_timer.start();
+        QTimer::singleShot(0, this, [this] { startJobs(); });
+    }
+
+private:
+    struct Job
+    {
+        QPointer<TextEditor::TextDocument> document;
+        std::vector<TrackedRange> ranges;
+        int retries = 0;
+    };
+
+    void startJobs()
+    {
+        const int maxRunning = std::max(1, QThread::idealThreadCount());
+        while (m_running < maxRunning && m_next < m_jobs.size())
+            start(m_next++);
+
+        if (m_running == 0 && m_next == m_jobs.size()) {
+            qCDebug(clangIndenterLog) << "Formatting batch:" << m_formatted << "of"
+                                      << m_jobs.size() << "documents formatted in"
+                                      << m_timer.elapsed() << "ms";
+            if (m_done)
+                m_done(m_formatted);
+            deleteLater();
+        }
+    }
+
+    void start(std::size_t index)
+    {
+        Job &job = m_jobs[index];
+        if (!job.document)
+            return;
+        const Utils::FilePath filePath = job.document->filePath();
+        if (getCurrentIndentationOrFormattingSettings(filePath) == ClangFormatSettings::Disable)
+            return;
+
+        QTextDocument *doc = job.document->document();
+        // The snapshot has to be the document with a previous result applied completely.
+        finishApplyingReplacements(doc);
+        const QByteArray buffer = Internal::documentBuffer(doc);
+        const std::vector<Utf8Range> ranges = utf8Ranges(doc, buffer, rangesInLines(job.ranges));
+        const clang::format::FormatStyle style = formatStyleForFile(filePath);
+        const int revision = doc->revision();
+
+        ++m_running;
+        QElapsedTimer timer;
+        timer.start();
+        const QFuture<Utf8Replacements> future = Utils::asyncRun([buffer, style, filePath, ranges] {
+            return formatBuffer(std::string_view(buffer.constData(), size_t(buffer.size())),
+                                style,
+                                filePath,
+                                ranges);
+        });
+        Utils::onResultReady(future,
+                             this,
+                             [this, index, buffer, revision, timer](
+                                 const Utf8Replacements &replacements) {
+                                 --m_running;
+                                 apply(index, buffer, revision, replacements, timer.nsecsElapsed());
+                                 startJobs();
+                             });
+        ExtensionSystem::PluginManager::futureSynchronizer()->addFuture(future);
+    }
+
+    void apply(std::size_t index,
+               const QByteArray &buffer,
+               int revision,
+               const Utf8Replacements &replacements,
+               qint64 elapsedNs)
+    {
+        Job &job = m_jobs[index];
+        if (!job.document)
+            return;
+
+        QTextDocument *doc = job.document->document();
+        if (doc->revision() != revision) {
+            // Edited meanwhile, the result does not fit anymore. The ranges moved with the edits.
+            if (job.retries++ < maxRetries) {
+                start(index);
+            } else if (TextEditor::Indenter *indenter = job.document->indenter()) {
+                indenter->format(rangesInLines(job.ranges));
+                ++m_formatted;
+            }
+            return;
+        }
+
+        Utils::Text::applyReplacements(doc, Internal::utf16Replacements(doc, buffer, replacements));
+        Statistics::recordFormatting(doc, job.document->filePath(), elapsedNs, buffer.size());
+        ++m_formatted;
+    }
+
+    std::vector<Job> m_jobs;
+    std::function<void(int)> m_done;
+    std::size_t m_next = 0;
+    int m_running = 0;
+    int m_formatted = 0;
+    QElapsedTimer m_timer;
+};
+
+void FormattingBatch::addRange(TextEditor::TextDocument *document,
+                               const TextEditor::RangeInLines &range)
+{
+    addRanges(document, {range});
+}
+
+void FormattingBatch::addRanges(TextEditor::TextDocument *document,
+                                const TextEditor::RangesInLines &ranges)
+{
+    QTC_ASSERT(document, return);
+    auto it = std::find_if(m_documents.begin(), m_documents.end(), [document](const Document &d) {
+        return d.document == document;
+    });
+    if (it == m_documents.end()) {
+        m_documents.push_back({document, {}});
+        it = std::prev(m_documents.end());
+    }
+    it->ranges.insert(it->ranges.end(), ranges.begin(), ranges.end());
+}
+
+void FormattingBatch::commit(const std::function<void(int formattedCount)> &done)
+{
+    new Runner(m_documents, done);
+    m_documents.clear();
+}
+
+} // namespace ClangFormat
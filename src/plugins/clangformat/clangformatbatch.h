@@ -0,0 +1,59 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <texteditor/indenter.h>
+
+#include <QPointer>
+
+#include <functional>
+#include <vector>
+
+namespace TextEditor { class TextDocument; }
+
+namespace ClangFormat {
+
+// Collects the ranges that a refactoring edits and formats each document once on commit(),
+// covering all of its ranges, instead of once per edit. clang-format runs on snapshots of the
+// documents in parallel, the results are applied in the main thread. The ranges move with the
+// edits of the document, and a document that was edited while its result was computed is
+// formatted again. Documents for which ClangFormat is disabled are skipped.
+//
+//     FormattingBatch batch;
+//     for (const Edit &edit : edits)
+//         batch.addRange(edit.document, {edit.startLine, edit.endLine});
+//     batch.commit();
+class FormattingBatch
+{
+public:
+    FormattingBatch() = default;
+    FormattingBatch(const FormattingBatch &) = delete;
+    FormattingBatch &operator=(const FormattingBatch &) = delete;
+
+    // Lines are 1-based and inclusive, like in TextEditor::RangesInLines.
+    void addRange(TextEditor::TextDocument *document, const TextEditor::RangeInLines &range);
+    void addRanges(TextEditor::TextDocument *document, const TextEditor::RangesInLines &ranges);
+
+    bool isEmpty() const { return m_documents.empty(); }
+    int documentCount() const { return int(m_documents.size()); }
+
+    // Clears the batch and formats its documents in the background, so that the editor stays
+    // responsive. Documents that were closed in the meantime are skipped. \a done gets the
+    // number of formatted documents. The batch can be destroyed right after commit().
+    void commit(const std::function<void(int formattedCount)> &done = {});
+    void discard() { m_documents.clear(); }
+
+private:
+    struct Document
+    {
+        QPointer<TextEditor::TextDocument> document;
+        TextEditor::RangesInLines ranges;
+    };
+
+    class Runner;
+
+    std::vector<Document> m_documents;
+};
+
+} // namespace ClangFormat
@@ -0,0 +1,176 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatbenchmark.h"
+
+#include "clangformatmemory.h"
+#include "clangformatstatistics.h"
+
+#include <QElapsedTimer>
+
+namespace ClangFormat::Benchmark {
+
+Q_LOGGING_CATEGORY(clangFormatBenchmarkLog, "qtc.clangformat.benchmark", QtWarningMsg)
+
+namespace {
+
+struct StartupTimes
+{
+    QElapsedTimer sincePluginInitialize;
+    qint64 initializeMs = -1;
+    bool indenterCreated = false;
+    bool indentRequested = false;
+    bool indentFinished = false;
+};
+
+StartupTimes &startupTimes()
+{
+    static StartupTimes times;
+    return times;
+}
+
+struct IndenterInstances
+{
+    int count = 0;
+};
+
+IndenterInstances &indenterInstances(IndenterKind kind)
+{
+    static IndenterInstances clangFormat;
+    static IndenterInstances builtIn;
+    return kind == IndenterKind::ClangFormat ? clangFormat : builtIn;
+}
+
+void reportIndenterInstances()
+{
+    const IndenterInstances &clangFormat = indenterInstances(IndenterKind::ClangFormat);
+    const IndenterInstances &builtIn = indenterInstances(IndenterKind::BuiltIn);
+    qCDebug(clangFormatBenchmarkLog).nospace()
+        << "Live indenters: " << clangFormat.count << " ClangFormat, " << builtIn.count
+        << " built-in";
+    // Documents being opened and closed are when growth shows.
+    reportMemory();
+}
+
+struct IndentationQueries
+{
+    int computed = 0;
+    int coalesced = 0;
+};
+
+IndentationQueries &indentationQueries()
+{
+    static IndentationQueries queries;
+    return queries;
+}
+
+void reportIndentationQueries()
+{
+    const IndentationQueries &queries = indentationQueries();
+    qCDebug(clangFormatBenchmarkLog).nospace()
+        << "Indentation queries: " << queries.computed << " computed, " << queries.coalesced
+        << " coalesced (reformat calls avoided)";
+}
+
+qint64 elapsedSincePluginInitialize()
+{
+    const StartupTimes &times = startupTimes();
+    return times.sincePluginInitialize.isValid() ? times.sincePluginInitialize.elapsed() : -1;
+}
+
+} // namespace
+
+void pluginInitializeStarted()
+{
+    startupTimes().sincePluginInitialize.start();
+}
+
+void pluginInitializeFinished()
+{
+    StartupTimes &times = startupTimes();
+    times.initializeMs = elapsedSincePluginInitialize();
+    Statistics::recordStartup(Statistics::StartupEvent::PluginInitialized, times.initializeMs);
+    qCDebug(clangFormatBenchmarkLog) << "ClangFormatPlugin::initialize took"
+                                     << times.initializeMs << "ms";
+}
+
+void firstIndenterCreated()
+{
+    StartupTimes &times = startupTimes();
+    if (times.indenterCreated)
+        return;
+    times.indenterCreated = true;
+    const qint64 elapsedMs = elapsedSincePluginInitialize();
+    Statistics::recordStartup(Statistics::StartupEvent::FirstIndenterCreated, elapsedMs);
+    qCDebug(clangFormatBenchmarkLog) << "First indenter created" << elapsedMs
+                                     << "ms after plugin initialization";
+}
+
+void firstIndentRequested()
+{
+    StartupTimes &times = startupTimes();
+    if (times.indentRequested)
+        return;
+    times.indentRequested = true;
+    const qint64 elapsedMs = elapsedSincePluginInitialize();
+    Statistics::recordStartup(Statistics::StartupEvent::FirstIndentRequested, elapsedMs);
+    qCDebug(clangFormatBenchmarkLog) << "First indentation requested" << elapsedMs
+                                     << "ms after plugin initialization";
+}
+
+void firstIndentFinished()
+{
+    StartupTimes &times = startupTimes();
+    if (times.indentFinished || !times.indentRequested)
+        return;
+    times.indentFinished = true;
+    const qint64 elapsedMs = elapsedSincePluginInitialize();
+    Statistics::recordStartup(Statistics::StartupEvent::FirstIndentFinished, elapsedMs);
+    qCDebug(clangFormatBenchmarkLog) << "Time to first indent:" << elapsedMs
+                                     << "ms after plugin initialization";
+}
+
+void indenterCreated(IndenterKind kind)
+{
+    ++indenterInstances(kind).count;
+    reportIndenterInstances();
+}
+
+void indenterReleased(IndenterKind kind)
+{
+    --indenterInstances(kind).count;
+    reportIndenterInstances();
+}
+
+void indentationComputed()
+{
+    ++indentationQueries().computed;
+    reportIndentationQueries();
+}
+
+void indentationCoalesced()
+{
+    ++indentationQueries().coalesced;
+    reportIndentationQueries();
+}
+
+int computedIndentationCount()
+{
+    return indentationQueries().computed;
+}
+
+int coalescedIndentationCount()
+{
+    return indentationQueries().coalesced;
+}
+
+void reportMemory()
+{
+    // Reading procfs is not free, only do it when somebody listens.
+    if (!clangFormatBenchmarkLog().isDebugEnabled())
+        return;
+    for (const QString &line : Memory::report().split('\n'))
+        qCDebug(clangFormatBenchmarkLog).noquote() << "Memory:" << line;
+}
+
+} // namespace ClangFormat::Benchmark
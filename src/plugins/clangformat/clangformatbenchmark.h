@@ -0,0 +1,44 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <QLoggingCategory>
+
+#include <cstddef>
+
+namespace ClangFormat::Benchmark {
+
+// Enable with QT_LOGGING_RULES="qtc.clangformat.benchmark=true".
+Q_DECLARE_LOGGING_CATEGORY(clangFormatBenchmarkLog)
+
+void pluginInitializeStarted();
+void pluginInitializeFinished();
+
+// Reports the time from plugin initialization to the first indenter being created
+// and to the first indentation or formatting request, also to Statistics::startup(). Only the
+// first call counts. Every path that computes indentation or formatting calls the latter two,
+// the ones that reuse an earlier result do not.
+void firstIndenterCreated();
+void firstIndentRequested();
+void firstIndentFinished();
+
+enum class IndenterKind { ClangFormat, BuiltIn };
+
+// Live per-document indenter instances, so that keeping both indenters of a
+// ClangFormatForwardingIndenter alive is visible with many open documents. Their memory is
+// measured by the caches in clangformatmemory.h, reported along with the instances.
+void indenterCreated(IndenterKind kind);
+void indenterReleased(IndenterKind kind);
+
+// Indentation queries for a document revision that was already indented in the same
+// event loop turn reuse that result instead of calling clang::format::reformat() again.
+void indentationComputed();
+void indentationCoalesced();
+int computedIndentationCount();
+int coalescedIndentationCount();
+
+// Logs the process memory and the sizes of the caches, see clangformatmemory.h.
+void reportMemory();
+
+} // namespace ClangFormat::Benchmark
@@ -0,0 +1,273 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatcalibration.h"
+
+#include "clangformatconstants.h"
+#include "clangformatformatter.h"
+#include "clangformatmemory.h"
+#include "clangformatsettings.h"
+#include "clangformattr.h"
+#include "clangformatutils.h"
+
+#include <coreplugin/icore.h>
+
+#include <extensionsystem/pluginmanager.h>
+
+#include <utils/async.h>
+#include <utils/futuresynchronizer.h>
+#include <utils/qtcsettings.h>
+
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <limits>
+
+using namespace Utils;
+
+namespace ClangFormat {
+
+namespace {
+// Requests faster than this say more about the overhead than about the throughput.
+const qint64 minSampleNs = 1000 * 1000;
+// Weight of a new sample, the average follows changes of the machine load slowly.
+const double sampleWeight = 0.2;
+const int minThresholdKb = 16;
+const int maxThresholdKb = 100 * 1024;
+const int probeSizeBytes = 128 * 1024;
+// Files whose style fingerprint is kept, the least recently used ones are resolved again.
+const int maxFileFingerprints = 256;
+
+const char probeSnippet[] = R"(namespace Probe {
+class Widget : public Base
+{
+public:
+    explicit Widget(int value, const std::string &name)
+        : m_value(value), m_name(name)
+    {}
+
+    int compute(const std::vector<int> &values) const
+    {
+        int sum = 0;
+        for (int value : values) {
+            if (value > m_value)
+                sum += value * 2;
+            else
+                sum -= value;
+        }
+        switch (sum % 3) {
+        case 0:
+            return sum;
+        default:
+            break;
+        }
+        return sum + static_cast<int>(m_name.size());
+    }
+
+private:
+    int m_value = 0;
+    std::string m_name;
+};
+} // namespace Probe
+)";
+
+// Indents a line in the middle of a synthetic file, like Enter would, and returns the
+// throughput of the fastest of a few runs.
+double probeBytesPerMs(const clang::format::FormatStyle &style)
+{
+    std::string buffer;
+    buffer.reserve(probeSizeBytes + sizeof(probeSnippet));
+    while (int(buffer.size()) < probeSizeBytes)
+        buffer += probeSnippet;
+    const size_t lineStart = buffer.find('\n', buffer.size() / 2) + 1;
+    const size_t lineEnd = buffer.find('\n', lineStart);
+
+    qint64 fastestNs = std::numeric_limits<qint64>::max();
+    for (int run = 0; run < 3; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        indentBuffer(buffer,
+                     style,
+                     FilePath::fromString("probe.cpp"),
+                     {int(lineStart), int(lineEnd - lineStart)},
+                     ReplacementsToKeep::OnlyIndent);
+        fastestNs = std::min(fastestNs, timer.nsecsElapsed());
+    }
+    return double(buffer.size()) * 1e6 / double(std::max<qint64>(fastestNs, 1));
+}
+} // namespace
+
+FileSizeCalibration &FileSizeCalibration::instance()
+{
+    static FileSizeCalibration calibration;
+    return calibration;
+}
+
+FileSizeCalibration::FileSizeCalibration()
+    : m_fileFingerprints(maxFileFingerprints)
+{
+    read();
+    Memory::addCache(this, "File size calibration", [this] {
+        qint64 bytes = 0;
+        // Only the keys, looking at the entries would change their order.
+        const QList<FilePath> files = m_fileFingerprints.keys();
+        for (const FilePath &file : files)
+            bytes += file.toString().capacity() * sizeof(QChar) + sizeof(FileFingerprint) + 16;
+        return bytes + m_measurements.size() * sizeof(Measurement);
+    });
+    connect(Core::ICore::instance(), &Core::ICore::saveSettingsRequested, this, [this] {
+        write();
+    });
+}
+
+// Empty if the file was not seen since the last style change.
+QString FileSizeCalibration::cachedFingerprint(const FilePath &filePath) const
+{
+    const FileFingerprint *file = m_fileFingerprints.object(filePath);
+    if (!file || file->styleGeneration != styleGeneration())
+        return {};
+    return file->fingerprint;
+}
+
+QString FileSizeCalibration::fingerprint(const FilePath &filePath,
+                                         const clang::format::FormatStyle &style)
+{
+    // Serializing the style is not free, do it once per file and style change.
+    QString result = cachedFingerprint(filePath);
+    if (result.isEmpty()) {
+        const QByteArray hash
+            = QCryptographicHash::hash(QByteArray::fromStdString(
+                                           clang::format::configurationAsText(style)),
+                                       QCryptographicHash::Md5);
+        result = QString::fromLatin1(hash.toHex().left(8));
+        m_fileFingerprints.insert(filePath, new FileFingerprint{result, styleGeneration()});
+    }
+    return result;
+}
+
+void FileSizeCalibration::recordReformat(const FilePath &filePath,
+                                         const clang::format::FormatStyle &style,
+                                         qint64 bufferBytes,
+                                         qint64 elapsedNs)
+{
+    const QString styleFingerprint = fingerprint(filePath, style);
+    probeIfNotMeasured(styleFingerprint, style);
+    if (elapsedNs < minSampleNs)
+        return;
+    addSample(styleFingerprint, double(bufferBytes) * 1e6 / double(elapsedNs), false);
+}
+
+void FileSizeCalibration::probeIfNotMeasured(const QString &fingerprint,
+                                             const clang::format::FormatStyle &style)
+{
+    if (!m_measurements.value(fingerprint).probed && !m_runningProbes.contains(fingerprint))
+        probe(fingerprint, style);
+}
+
+void FileSizeCalibration::probe(const QString &fingerprint, const clang::format::FormatStyle &style)
+{
+    m_runningProbes.insert(fingerprint);
+    // The probe only works on its copy of the style, the result is taken in the main thread
+    // as long as the calibration exists. Shutdown waits for a running probe.
+    const QFuture<double> future = Utils::asyncRun([style] { return probeBytesPerMs(style); });
+    Utils::onResultReady(future, this, [this, fingerprint](double bytesPerMs) {
+        m_runningProbes.remove(fingerprint);
+        addSample(fingerprint, bytesPerMs, true);
+    });
+    ExtensionSystem::PluginManager::futureSynchronizer()->addFuture(future);
+}
+
+void FileSizeCalibration::addSample(const QString &fingerprint, double bytesPerMs, bool fromProbe)
+{
+    Measurement &measurement = m_measurements[fingerprint];
+    measurement.bytesPerMs = measurement.samples == 0
+                                 ? bytesPerMs
+                                 : (1 - sampleWeight) * measurement.bytesPerMs
+                                       + sampleWeight * bytesPerMs;
+    ++measurement.samples;
+    measurement.probed = measurement.probed || fromProbe;
+    m_lastFingerprint = fingerprint;
+    emit changed();
+}
+
+int FileSizeCalibration::threshold(double bytesPerMs) const
+{
+    const double targetMs = ClangFormatSettings::instance().latencyTarget();
+    const double thresholdKb = bytesPerMs * targetMs / 1024;
+    return int(std::clamp(thresholdKb, double(minThresholdKb), double(maxThresholdKb)));
+}
+
+// The throughput of all measured styles, weighted by their samples, says how fast the machine
+// is while the style of a file is still being probed.
+int FileSizeCalibration::machineThreshold() const
+{
+    double weightedBytesPerMs = 0;
+    int samples = 0;
+    for (const Measurement &measurement : m_measurements) {
+        weightedBytesPerMs += measurement.bytesPerMs * measurement.samples;
+        samples += measurement.samples;
+    }
+    return samples == 0 ? 0 : threshold(weightedBytesPerMs / samples);
+}
+
+int FileSizeCalibration::thresholdFor(const FilePath &filePath)
+{
+    QString styleFingerprint = cachedFingerprint(filePath);
+    if (styleFingerprint.isEmpty()) {
+        const clang::format::FormatStyle style = formatStyleForFile(filePath);
+        styleFingerprint = fingerprint(filePath, style);
+        probeIfNotMeasured(styleFingerprint, style);
+    }
+
+    const auto it = m_measurements.constFind(styleFingerprint);
+    if (it != m_measurements.constEnd() && it->samples > 0)
+        return threshold(it->bytesPerMs);
+    return machineThreshold();
+}
+
+QString FileSizeCalibration::basis() const
+{
+    const auto it = m_measurements.constFind(m_lastFingerprint);
+    if (it == m_measurements.constEnd() || it->samples == 0)
+        return Tr::tr("Not calibrated yet, the fixed threshold is used.");
+    return Tr::tr("Calibrated threshold: %1 KB. Style %2 is indented at %3 KB/ms, measured "
+                  "from %n request(s)%4.",
+                  nullptr,
+                  it->samples)
+        .arg(threshold(it->bytesPerMs))
+        .arg(m_lastFingerprint)
+        .arg(it->bytesPerMs / 1024, 0, 'f', 1)
+        .arg(it->probed ? Tr::tr(" including a synthetic probe") : QString());
+}
+
+void FileSizeCalibration::read()
+{
+    QtcSettings *settings = Core::ICore::settings();
+    settings->beginGroup(Constants::SETTINGS_ID);
+    const QVariantMap measurements = settings->value(Constants::FILE_SIZE_CALIBRATION_ID).toMap();
+    settings->endGroup();
+
+    for (auto it = measurements.cbegin(); it != measurements.cend(); ++it) {
+        const QVariantList values = it.value().toList();
+        if (values.size() != 3)
+            continue;
+        m_measurements.insert(it.key(),
+                              {values.at(0).toDouble(), values.at(1).toInt(), values.at(2).toBool()});
+        m_lastFingerprint = it.key();
+    }
+}
+
+void FileSizeCalibration::write() const
+{
+    QVariantMap measurements;
+    for (auto it = m_measurements.cbegin(); it != m_measurements.cend(); ++it)
+        measurements.insert(it.key(), QVariantList{it->bytesPerMs, it->samples, it->probed});
+
+    QtcSettings *settings = Core::ICore::settings();
+    settings->beginGroup(Constants::SETTINGS_ID);
+    settings->setValue(Constants::FILE_SIZE_CALIBRATION_ID, measurements);
+    settings->endGroup();
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,77 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/filepath.h>
+
+#include <clang/Format/Format.h>
+
+#include <QCache>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+namespace ClangFormat {
+
+// Measures how fast clang-format indents on this machine, per style, and derives the file
+// size above which indenting a line is expected to exceed the latency target of the settings.
+// Real indentation requests are recorded, a short synthetic probe runs in the background the
+// first time a style is seen. The measurements are kept in the settings.
+class FileSizeCalibration : public QObject
+{
+    Q_OBJECT
+
+public:
+    static FileSizeCalibration &instance();
+
+    void recordReformat(const Utils::FilePath &filePath,
+                        const clang::format::FormatStyle &style,
+                        qint64 bufferBytes,
+                        qint64 elapsedNs);
+
+    // The calibrated threshold in KB for the file: the one of its resolved style if that was
+    // measured, otherwise the one of all styles measured on this machine, or 0 if nothing was
+    // measured yet and the fixed threshold of the settings applies. The style of a file is
+    // resolved once per style change and probed if it was not measured yet, so that files
+    // that are too big for clang-format get a threshold without being formatted first.
+    int thresholdFor(const Utils::FilePath &filePath);
+    // What the last calibrated threshold is based on, for the settings page.
+    QString basis() const;
+
+signals:
+    void changed();
+
+private:
+    FileSizeCalibration();
+
+    struct Measurement
+    {
+        double bytesPerMs = 0;
+        int samples = 0;
+        bool probed = false;
+    };
+
+    QString cachedFingerprint(const Utils::FilePath &filePath) const;
+    QString fingerprint(const Utils::FilePath &filePath, const clang::format::FormatStyle &style);
+    void addSample(const QString &fingerprint, double bytesPerMs, bool fromProbe);
+    void probeIfNotMeasured(const QString &fingerprint, const clang::format::FormatStyle &style);
+    void probe(const QString &fingerprint, const clang::format::FormatStyle &style);
+    int threshold(double bytesPerMs) const;
+    int machineThreshold() const;
+    void read();
+    void write() const;
+
+    struct FileFingerprint
+    {
+        QString fingerprint;
+        int styleGeneration = -1; // see styleGeneration()
+    };
+
+    QHash<QString, Measurement> m_measurements;          // by style fingerprint
+    QCache<Utils::FilePath, FileFingerprint> m_fileFingerprints; // of recently used files
+    QSet<QString> m_runningProbes;
+    QString m_lastFingerprint;
+};
+
+} // namespace ClangFormat
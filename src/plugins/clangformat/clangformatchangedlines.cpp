@@ -0,0 +1,278 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatchangedlines.h"
+
+#include "clangformatmemory.h"
+#include "clangformattr.h"
+
+#include <utils/differ.h>
+#include <utils/filesystemwatcher.h>
+#include <utils/qtcprocess.h>
+
+#include <QCoreApplication>
+#include <QFuture>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+#include <QtConcurrent>
+
+using namespace TextEditor;
+using namespace Utils;
+
+namespace ClangFormat {
+
+static expected_str<QByteArray> runGit(const FilePath &workingDirectory,
+                                       const QStringList &arguments)
+{
+    const FilePath git = workingDirectory.withNewPath("git").searchInPath();
+    if (git.isEmpty())
+        return make_unexpected(Tr::tr("The git executable was not found."));
+
+    Process process;
+    process.setCommand({git, arguments});
+    process.setWorkingDirectory(workingDirectory);
+    process.runBlocking();
+    if (process.result() != ProcessResult::FinishedWithSuccess)
+        return make_unexpected(process.cleanedStdErr().trimmed());
+    return process.rawStdOut();
+}
+
+// A commit rewrites the index, a checkout or reset at least appends to the HEAD log.
+static FilePaths gitStampFiles(const FilePath &gitDirectory)
+{
+    return {gitDirectory.pathAppended("index"), gitDirectory.pathAppended("logs/HEAD")};
+}
+
+static QDateTime gitStamp(const FilePath &gitDirectory)
+{
+    QDateTime result;
+    for (const FilePath &file : gitStampFiles(gitDirectory))
+        result = std::max(result, file.lastModified());
+    return result;
+}
+
+expected_str<GitBase> gitBase(const FilePath &filePath, GitDiffBase base)
+{
+    const FilePath workingDirectory = filePath.parentDir();
+    const expected_str<QByteArray> gitDirectory
+        = runGit(workingDirectory, {"rev-parse", "--absolute-git-dir"});
+    if (!gitDirectory)
+        return make_unexpected(gitDirectory.error());
+
+    GitBase result;
+    result.gitDirectory = workingDirectory.withNewPath(
+        QString::fromUtf8(gitDirectory->trimmed()));
+    // Taken before reading the contents, so that a concurrent commit makes them outdated.
+    result.stamp = gitStamp(result.gitDirectory);
+
+    const QString object = (base == GitDiffBase::Head ? QString("HEAD:./") : QString(":./"))
+                           + filePath.fileName();
+    // Fails for files that are not tracked yet, all of their lines are new.
+    if (const expected_str<QByteArray> contents = runGit(workingDirectory, {"show", object}))
+        result.contents = QString::fromUtf8(*contents).replace("\r\n", "\n");
+    return result;
+}
+
+RangesInLines changedLines(const QString &base, const QString &current)
+{
+    Differ differ;
+    differ.setDiffMode(Differ::LineMode);
+
+    RangesInLines result;
+    int line = 1;
+    for (const Diff &diff : differ.diff(base, current)) {
+        if (diff.command == Diff::Delete)
+            continue;
+        const int lineBreaks = diff.text.count('\n');
+        if (diff.command == Diff::Insert) {
+            // The last line of the document has no line break.
+            const int lastLine = line + lineBreaks - (diff.text.endsWith('\n') ? 1 : 0);
+            if (!result.empty() && result.back().endLine + 1 >= line)
+                result.back().endLine = lastLine;
+            else
+                result.push_back({line, lastLine});
+        }
+        line += lineBreaks;
+    }
+    return result;
+}
+
+namespace {
+
+struct CachedChangedLines
+{
+    QFuture<expected_str<GitBase>> base;
+    // Whether the Git directory of the finished base is watched.
+    bool watched = false;
+    bool outdated = false;
+    int revision = -1;
+    QFuture<std::optional<RangesInLines>> changedLines;
+};
+
+// Only used from the main thread, the futures do the work in the background. Whether a base is
+// outdated is told by a file system watcher on its Git directory, the files are not checked
+// for every keystroke.
+class ChangedLinesCache
+{
+public:
+    static ChangedLinesCache &instance()
+    {
+        static ChangedLinesCache cache;
+        return cache;
+    }
+
+    ChangedLinesCache()
+    {
+        Memory::addCache(this, "Git base contents", [this] {
+            qint64 bytes = 0;
+            for (const QHash<FilePath, CachedChangedLines> &entries : m_entries) {
+                for (const CachedChangedLines &entry : entries)
+                    bytes += ChangedLinesCache::bytes(entry);
+            }
+            return bytes;
+        });
+    }
+
+    qint64 bytes(const FilePath &filePath) const
+    {
+        qint64 result = 0;
+        for (const QHash<FilePath, CachedChangedLines> &entries : m_entries)
+            result += bytes(entries.value(filePath));
+        return result;
+    }
+
+    CachedChangedLines &entry(const FilePath &filePath, GitDiffBase base)
+    {
+        CachedChangedLines &entry = m_entries[int(base)][filePath];
+        if (entry.base.isValid() && !entry.watched && entry.base.isFinished())
+            watch(entry);
+        if (!entry.base.isValid() || entry.outdated) {
+            entry.base = QtConcurrent::run([filePath, base] { return gitBase(filePath, base); });
+            entry.watched = false;
+            entry.outdated = false;
+            entry.revision = -1;
+        }
+        return entry;
+    }
+
+    void remove(const FilePath &filePath)
+    {
+        for (QHash<FilePath, CachedChangedLines> &entries : m_entries)
+            entries.remove(filePath);
+    }
+
+private:
+    static qint64 bytes(const CachedChangedLines &entry)
+    {
+        if (!entry.base.isValid() || !entry.base.isFinished() || !entry.base.result())
+            return 0;
+        return entry.base.result()->contents.capacity() * sizeof(QChar);
+    }
+
+    void watch(CachedChangedLines &entry)
+    {
+        entry.watched = true;
+        const expected_str<GitBase> result = entry.base.result();
+        if (!result)
+            return;
+        if (!m_watcher) {
+            m_watcher = new FileSystemWatcher(QCoreApplication::instance());
+            QObject::connect(m_watcher,
+                             &FileSystemWatcher::fileChanged,
+                             [this](const QString &path) {
+                                 gitFileChanged(FilePath::fromString(path));
+                             });
+        }
+        if (!m_watchedGitDirectories.contains(result->gitDirectory)) {
+            m_watchedGitDirectories.insert(result->gitDirectory);
+            for (const FilePath &file : gitStampFiles(result->gitDirectory)) {
+                if (file.exists())
+                    m_watcher->addFile(file.toString(), FileSystemWatcher::WatchModifiedDate);
+            }
+        }
+        // Once per read, for a commit between reading the base and watching the directory.
+        entry.outdated = gitStamp(result->gitDirectory) != result->stamp;
+    }
+
+    void gitFileChanged(const FilePath &file)
+    {
+        for (QHash<FilePath, CachedChangedLines> &entries : m_entries) {
+            for (CachedChangedLines &entry : entries) {
+                if (!entry.watched)
+                    continue;
+                const expected_str<GitBase> result = entry.base.result();
+                if (result && file.isChildOf(result->gitDirectory))
+                    entry.outdated = true;
+            }
+        }
+        // Git replaces the index by renaming a new one over it, which ends watching the old
+        // file.
+        m_watcher->removeFile(file.toString());
+        if (file.exists())
+            m_watcher->addFile(file.toString(), FileSystemWatcher::WatchModifiedDate);
+    }
+
+    QHash<FilePath, CachedChangedLines> m_entries[2];
+    QPointer<FileSystemWatcher> m_watcher;
+    QSet<FilePath> m_watchedGitDirectories;
+};
+
+} // namespace
+
+void prefetchGitBase(const FilePath &filePath, GitDiffBase base)
+{
+    ChangedLinesCache::instance().entry(filePath, base);
+}
+
+static QFuture<std::optional<RangesInLines>> changedLinesFuture(const FilePath &filePath,
+                                                               GitDiffBase base,
+                                                               int revision,
+                                                               const QString &text)
+{
+    CachedChangedLines &entry = ChangedLinesCache::instance().entry(filePath, base);
+    if (entry.revision != revision) {
+        entry.revision = revision;
+        entry.changedLines = entry.base.then(
+            QtFuture::Launch::Async,
+            [text](const expected_str<GitBase> &base) -> std::optional<RangesInLines> {
+                if (!base)
+                    return {};
+                return changedLines(base->contents, text);
+            });
+    }
+    return entry.changedLines;
+}
+
+void prefetchChangedLines(const FilePath &filePath,
+                          GitDiffBase base,
+                          int revision,
+                          const QString &text)
+{
+    changedLinesFuture(filePath, base, revision, text);
+}
+
+std::optional<RangesInLines> changedLines(const FilePath &filePath,
+                                          GitDiffBase base,
+                                          int revision,
+                                          const QString &text)
+{
+    // Saving must not wait for git, the caller falls back to the edited lines.
+    const QFuture<std::optional<RangesInLines>> future
+        = changedLinesFuture(filePath, base, revision, text);
+    if (!future.isFinished())
+        return {};
+    return future.result();
+}
+
+void releaseChangedLines(const FilePath &filePath)
+{
+    ChangedLinesCache::instance().remove(filePath);
+}
+
+qint64 changedLinesBytes(const FilePath &filePath)
+{
+    return ChangedLinesCache::instance().bytes(filePath);
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,53 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <texteditor/indenter.h>
+
+#include <utils/filepath.h>
+
+#include <QDateTime>
+
+#include <optional>
+
+// The lines of a document that changed against the local Git repository, like
+// git clang-format determines them. Only the git executable is used, nothing is fetched.
+
+namespace ClangFormat {
+
+enum class GitDiffBase { Index, Head };
+
+struct GitBase
+{
+    QString contents;
+    Utils::FilePath gitDirectory;
+    // Changes whenever the index or HEAD moves, to tell whether the contents are outdated.
+    QDateTime stamp;
+};
+
+// Runs git, blocking. Files that are not tracked in \a base have empty contents, so that all
+// of their lines count as changed. Fails for files outside of a Git work tree.
+Utils::expected_str<GitBase> gitBase(const Utils::FilePath &filePath, GitDiffBase base);
+
+// The lines of \a current that were added or modified against \a base. Deleted lines do not
+// count, formatting their neighbors would touch unchanged code.
+TextEditor::RangesInLines changedLines(const QString &base, const QString &current);
+
+// Cached versions of the above for the editor. The base is read in the background and kept
+// until the index or HEAD moves, the changed lines are kept per document revision.
+void prefetchGitBase(const Utils::FilePath &filePath, GitDiffBase base);
+void prefetchChangedLines(const Utils::FilePath &filePath,
+                          GitDiffBase base,
+                          int revision,
+                          const QString &text);
+// Never waits: returns nothing while the prefetches are still running, starting them if
+// needed, and for files outside of a Git work tree.
+std::optional<TextEditor::RangesInLines> changedLines(const Utils::FilePath &filePath,
+                                                      GitDiffBase base,
+                                                      int revision,
+                                                      const QString &text);
+void releaseChangedLines(const Utils::FilePath &filePath);
+qint64 changedLinesBytes(const Utils::FilePath &filePath);
+
+} // namespace ClangFormat
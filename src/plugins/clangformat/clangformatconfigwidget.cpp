@@ -298,6 +298,7 @@ void ClangFormatConfigWidget::createStyleFileIfNeeded(bool isGlobal)
 
     const std::string config = clang::format::configurationAsText(constructStyle());
     configFile.writeFileContents(QByteArray::fromStdString(config));
+    invalidateStyles();
 }
 
 void ClangFormatConfigWidget::updatePreview()
@@ -11,10 +11,22 @@ static const char SAMPLE_FILE_NAME[] = "test.cpp";
 static const char SETTINGS_ID[] = "ClangFormat";
 static const char USE_CUSTOM_SETTINGS_ID[] = "ClangFormat.OverrideFile";
 static const char FORMAT_CODE_ON_SAVE_ID[] = "ClangFormat.FormatCodeOnSave";
+static const char FORMAT_ON_SAVE_RANGES_ID[] = "ClangFormat.FormatOnSaveRanges";
 static const char FORMAT_WHILE_TYPING_ID[] = "ClangFormat.FormatWhileTyping";
+static const char FORMAT_WHILE_TYPING_DELAY_ID[] = "ClangFormat.FormatWhileTypingDelay";
 static const char MODE_ID[] = "ClangFormat.Mode";
 static const char FILE_SIZE_THREDSHOLD[] = "ClangFormat.FileSizeThreshold";
+static const char CALIBRATE_FILE_SIZE_THRESHOLD_ID[] = "ClangFormat.CalibrateFileSizeThreshold";
+static const char LATENCY_TARGET_ID[] = "ClangFormat.LatencyTarget";
+static const char FILE_SIZE_CALIBRATION_ID[] = "ClangFormat.FileSizeCalibration";
+static const char SLOW_REQUEST_THRESHOLD_ID[] = "ClangFormat.SlowRequestThreshold";
+static const char DOCUMENT_STATE_BUDGET_ID[] = "ClangFormat.DocumentStateBudget";
+static const char INDENTATION_ENGINE_ID[] = "ClangFormat.IndentationEngine";
 static const char USE_GLOBAL_SETTINGS[] = "ClangFormat.UseGlobalSettings";
 static const char OPEN_CURRENT_CONFIG_ID[] = "ClangFormat.OpenCurrentConfig";
+static const char SHOW_MEMORY_USAGE_ID[] = "ClangFormat.ShowMemoryUsage";
+static const char SHOW_STATISTICS_ID[] = "ClangFormat.ShowStatistics";
+static const char APPLY_REPLACEMENTS_TASK_ID[] = "ClangFormat.ApplyReplacements";
+static const char APPLY_FORMATTING_IN_SLICES_ID[] = "ClangFormat.ApplyFormattingInSlices";
 } // namespace Constants
 } // namespace ClangFormat
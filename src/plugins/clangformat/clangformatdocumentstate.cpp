@@ -0,0 +1,93 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatdocumentstate.h"
+
+#include "clangformatmemory.h"
+#include "clangformatsettings.h"
+
+#include <QTimer>
+
+namespace ClangFormat {
+
+DocumentStateBudget &DocumentStateBudget::instance()
+{
+    static DocumentStateBudget budget;
+    return budget;
+}
+
+DocumentStateBudget::DocumentStateBudget()
+{
+    Memory::addCache(this, "Document state within the budget", [this] { return m_totalBytes; });
+}
+
+void DocumentStateBudget::add(const void *document,
+                              const SizeFunction &size,
+                              const ReleaseFunction &release)
+{
+    if (m_positions.count(document))
+        return;
+    m_entries.push_front({document, size, release, 0});
+    m_positions[document] = m_entries.begin();
+}
+
+void DocumentStateBudget::remove(const void *document)
+{
+    const auto position = m_positions.find(document);
+    if (position == m_positions.end())
+        return;
+    m_totalBytes -= position->second->bytes;
+    m_entries.erase(position->second);
+    m_positions.erase(position);
+}
+
+void DocumentStateBudget::touch(const void *document)
+{
+    const auto position = m_positions.find(document);
+    if (position == m_positions.end())
+        return;
+    // Constant time, the sizes of the other documents did not change since they were used.
+    m_entries.splice(m_entries.begin(), m_entries, position->second);
+    Entry &entry = m_entries.front();
+    if (entry.touched)
+        return;
+    entry.touched = true;
+    if (m_touched.empty())
+        QTimer::singleShot(0, [this] { measureTouched(); });
+    m_touched.push_back(document);
+}
+
+void DocumentStateBudget::measureTouched()
+{
+    for (const void *document : m_touched) {
+        const auto position = m_positions.find(document);
+        if (position == m_positions.end())
+            continue; // closed in the meantime
+        Entry &entry = *position->second;
+        const qint64 bytes = entry.size();
+        m_totalBytes += bytes - entry.bytes;
+        entry.bytes = bytes;
+        entry.touched = false;
+    }
+    m_touched.clear();
+    enforceBudget();
+}
+
+void DocumentStateBudget::enforceBudget()
+{
+    const qint64 budget = qint64(ClangFormatSettings::instance().documentStateBudget()) * 1024
+                          * 1024;
+    if (m_totalBytes <= budget || m_entries.empty())
+        return;
+    // The document in use keeps its state even if it alone exceeds the budget.
+    for (auto it = std::prev(m_entries.end()); m_totalBytes > budget && it != m_entries.begin();
+         --it) {
+        if (it->bytes == 0)
+            continue;
+        it->release();
+        m_totalBytes -= it->bytes;
+        it->bytes = 0;
+    }
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,58 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace ClangFormat {
+
+// Keeps the state that the indenters of the open documents cache within a global budget.
+// Documents are ordered by their last use. When the state of all documents together exceeds
+// the budget of the settings, the least recently used ones release theirs and rebuild it
+// lazily when they are used again. Main thread only.
+class DocumentStateBudget
+{
+public:
+    static DocumentStateBudget &instance();
+
+    using SizeFunction = std::function<qint64()>;
+    using ReleaseFunction = std::function<void()>;
+
+    void add(const void *document, const SizeFunction &size, const ReleaseFunction &release);
+    void remove(const void *document);
+
+    // Marks the document as the most recently used one. Called for every request to an
+    // indenter, so the state of the touched documents is measured again and the state of
+    // the coldest documents released only once per event loop turn.
+    void touch(const void *document);
+
+    qint64 totalBytes() const { return m_totalBytes; }
+
+private:
+    DocumentStateBudget();
+
+    struct Entry
+    {
+        const void *document = nullptr;
+        SizeFunction size;
+        ReleaseFunction release;
+        qint64 bytes = 0;
+        bool touched = false;
+    };
+
+    void measureTouched();
+    void enforceBudget();
+
+    std::list<Entry> m_entries; // most recently used first
+    std::unordered_map<const void *, std::list<Entry>::iterator> m_positions;
+    std::vector<const void *> m_touched;
+    qint64 m_totalBytes = 0;
+};
+
+} // namespace ClangFormat
@@ -91,6 +91,7 @@ void ClangFormatFile::saveStyleToFile(clang::format::FormatStyle style, Utils::F
         .insert(0,
                 "# yaml-language-server: $schema=https://json.schemastore.org/clang-format.json\n");
     filePath.writeFileContents(QByteArray::fromStdString(styleStr));
+    invalidateStyles();
 }
 
 void ClangFormatFile::removeClangFormatFileForStylePreferences(
@@ -0,0 +1,427 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatformatter.h"
+
+#include <clang/Tooling/Core/Replacement.h>
+
+#include <utils/algorithm.h>
+#include <utils/qtcassert.h>
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace ClangFormat {
+
+namespace {
+void adjustFormatStyleForLineBreak(clang::format::FormatStyle &style,
+                                   ReplacementsToKeep replacementsToKeep)
+{
+    style.MaxEmptyLinesToKeep = 100;
+#if LLVM_VERSION_MAJOR > 20
+    style.SortIncludes = {.Enabled = false};
+#elif LLVM_VERSION_MAJOR >= 13
+    style.SortIncludes = clang::format::FormatStyle::SI_Never;
+#else
+    style.SortIncludes = false;
+#endif
+#if LLVM_VERSION_MAJOR >= 16
+    style.SortUsingDeclarations = clang::format::FormatStyle::SUD_Never;
+#else
+    style.SortUsingDeclarations = false;
+#endif
+
+    // This is a separate pass, don't do it unless it's the full formatting.
+    style.FixNamespaceComments = false;
+#if LLVM_VERSION_MAJOR >= 16
+    style.AlignTrailingComments = {clang::format::FormatStyle::TCAS_Never, 0};
+#else
+    style.AlignTrailingComments = false;
+#endif
+
+    if (replacementsToKeep == ReplacementsToKeep::IndentAndBefore)
+        return;
+
+    style.ColumnLimit = 0;
+#ifdef KEEP_LINE_BREAKS_FOR_NON_EMPTY_LINES_BACKPORTED
+    style.KeepLineBreaksForNonEmptyLines = true;
+#endif
+}
+
+llvm::StringRef clearExtraNewline(llvm::StringRef text)
+{
+#if LLVM_VERSION_MAJOR >= 16
+    while (text.starts_with("\n\n"))
+#else
+    while (text.startswith("\n\n"))
+#endif
+        text = text.drop_front();
+    return text;
+}
+
+int newlineCount(std::string_view text)
+{
+    return int(std::count(text.begin(), text.end(), '\n'));
+}
+
+Utf8Replacements filteredReplacements(std::string_view buffer,
+                                      const clang::tooling::Replacements &replacements,
+                                      int utf8Offset,
+                                      int utf8Length,
+                                      ReplacementsToKeep replacementsToKeep)
+{
+    Utf8Replacements filtered;
+    for (const clang::tooling::Replacement &replacement : replacements) {
+        const int replacementOffset = static_cast<int>(replacement.getOffset());
+
+        // Skip everything after.
+        if (replacementOffset >= utf8Offset + utf8Length)
+            return filtered;
+
+        const bool isNotIndentOrInRange = replacementOffset < utf8Offset - 1
+                                          || replacementOffset >= int(buffer.size())
+                                          || buffer[replacementOffset] != '\n';
+        if (isNotIndentOrInRange && replacementsToKeep == ReplacementsToKeep::OnlyIndent)
+            continue;
+
+        llvm::StringRef text = replacementsToKeep == ReplacementsToKeep::OnlyIndent
+                                   ? clearExtraNewline(replacement.getReplacementText())
+                                   : replacement.getReplacementText();
+        if (replacementsToKeep == ReplacementsToKeep::OnlyIndent
+            && int(text.count('\n'))
+                   != newlineCount(buffer.substr(replacementOffset, replacement.getLength()))) {
+            continue;
+        }
+
+        filtered.push_back({replacementOffset, int(replacement.getLength()), text.str()});
+    }
+    return filtered;
+}
+
+Utf8Replacements toUtf8Replacements(const clang::tooling::Replacements &replacements)
+{
+    Utf8Replacements result;
+    result.reserve(replacements.size());
+    for (const clang::tooling::Replacement &replacement : replacements) {
+        result.push_back({int(replacement.getOffset()),
+                          int(replacement.getLength()),
+                          replacement.getReplacementText().str()});
+    }
+    return result;
+}
+
+// Above these, clang::format::reformat() gets super-linear on generated code like data tables,
+// minified code or deeply nested macro expansions.
+const int maxLineLength = 4000;
+const int maxListElements = 2000;
+const int maxNestingDepth = 64;
+// Bracket pairs on an overlong line that are shorter than this are left alone.
+const int minOpaqueLineRegionLength = 256;
+// The super-linear cost needs enough code to matter. Smaller buffers are not scanned, which
+// keeps the scan off the typing path of ordinary files.
+const int minScannedBufferSize = 16 * 1024;
+
+bool isIdentifierChar(char c)
+{
+    // Bytes of multi-byte UTF-8 sequences count, identifiers may contain them.
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_'
+           || static_cast<unsigned char>(c) >= 0x80;
+}
+
+bool isRawStringPrefix(std::string_view word)
+{
+    return word == "R" || word == "u8R" || word == "uR" || word == "UR" || word == "LR";
+}
+
+bool overlaps(const Utf8Range &range, int start, int end)
+{
+    return range.offset < end && start < range.offset + range.length;
+}
+
+// Scans the buffer once and returns the interiors of the bracket pairs that exceed the limits,
+// sorted and without overlaps. Brackets in comments and literals are skipped.
+std::vector<Utf8Range> pathologicalRegions(std::string_view buffer)
+{
+    struct Bracket
+    {
+        int offset;
+        int lineStart;
+        int elements;
+        bool deeper; // contains brackets nested deeper than maxNestingDepth
+    };
+
+    std::vector<Bracket> brackets;
+    std::vector<Utf8Range> regions;
+    std::vector<Utf8Range> lineCandidates;
+    int lineStart = 0;
+    const int size = int(buffer.size());
+
+    const auto finishLine = [&](int lineEnd) {
+        if (lineEnd - lineStart > maxLineLength)
+            regions.insert(regions.end(), lineCandidates.begin(), lineCandidates.end());
+        lineCandidates.clear();
+        lineStart = lineEnd + 1;
+    };
+    // Skips to the end of a comment or literal, keeping track of the lines.
+    const auto skipTo = [&](int from, std::string_view end) {
+        size_t found = buffer.find(end, size_t(from));
+        const int stop = found == std::string_view::npos ? size : int(found + end.size()) - 1;
+        for (int i = from; i < stop; ++i) {
+            if (buffer[i] == '\n')
+                finishLine(i);
+        }
+        return stop;
+    };
+
+    // Returns the end of the raw string literal whose opening quote is at \a quote, or -1 if
+    // there is no valid delimiter.
+    const auto skipRawString = [&](int quote) {
+        const int maxDelimiterLength = 16;
+        int paren = quote + 1;
+        while (paren < size && paren - quote - 1 <= maxDelimiterLength && buffer[paren] != '('
+               && buffer[paren] != ')' && buffer[paren] != '\\' && buffer[paren] != '"'
+               && !std::isspace(static_cast<unsigned char>(buffer[paren]))) {
+            ++paren;
+        }
+        if (paren >= size || buffer[paren] != '(' || paren - quote - 1 > maxDelimiterLength)
+            return -1;
+        const std::string end = ")" + std::string(buffer.substr(quote + 1, paren - quote - 1))
+                                + "\"";
+        return skipTo(paren + 1, end);
+    };
+    // The end of a preprocessing number, which includes digit separators like in 1'000.
+    const auto numberEnd = [&](int from) {
+        int i = from + 1;
+        while (i < size) {
+            const char ch = buffer[i];
+            if (isIdentifierChar(ch) || ch == '.') {
+                ++i;
+            } else if (ch == '\'' && i + 1 < size && isIdentifierChar(buffer[i + 1])) {
+                i += 2;
+            } else if ((ch == '+' || ch == '-')
+                       && std::strchr("eEpP", buffer[i - 1]) != nullptr) {
+                ++i;
+            } else {
+                break;
+            }
+        }
+        return i;
+    };
+
+    for (int i = 0; i < size; ++i) {
+        const char c = buffer[i];
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            i = numberEnd(i) - 1;
+            continue;
+        }
+        if (isIdentifierChar(c)) {
+            // Whole words, so that only the encoding prefixes of literals precede a quote.
+            int end = i + 1;
+            while (end < size && isIdentifierChar(buffer[end]))
+                ++end;
+            if (end < size && buffer[end] == '"' && isRawStringPrefix(buffer.substr(i, end - i))) {
+                const int rawStringEnd = skipRawString(end);
+                if (rawStringEnd >= 0) {
+                    i = rawStringEnd;
+                    continue;
+                }
+            }
+            i = end - 1;
+            continue;
+        }
+        switch (c) {
+        case '\n':
+            finishLine(i);
+            break;
+        case '/':
+            if (i + 1 < size && buffer[i + 1] == '/')
+                i = int(std::min(buffer.find('\n', size_t(i)), buffer.size())) - 1;
+            else if (i + 1 < size && buffer[i + 1] == '*')
+                i = skipTo(i + 2, "*/");
+            break;
+        case '"':
+        case '\'':
+            for (++i; i < size && buffer[i] != c && buffer[i] != '\n'; ++i) {
+                if (buffer[i] == '\\')
+                    ++i;
+            }
+            if (i < size && buffer[i] == '\n')
+                --i; // unterminated, let the loop see the line break
+            break;
+        case '{':
+        case '(':
+        case '[':
+            brackets.push_back({i, lineStart, 0, false});
+            if (int(brackets.size()) > maxNestingDepth)
+                brackets[maxNestingDepth - 1].deeper = true;
+            break;
+        case '}':
+        case ')':
+        case ']': {
+            if (brackets.empty())
+                break;
+            const Bracket bracket = brackets.back();
+            const int depth = int(brackets.size());
+            brackets.pop_back();
+            const Utf8Range interior{bracket.offset + 1, i - bracket.offset - 1};
+            if (bracket.elements >= maxListElements
+                || (depth == maxNestingDepth && bracket.deeper)) {
+                regions.push_back(interior);
+            } else if (bracket.lineStart == lineStart
+                       && interior.length >= minOpaqueLineRegionLength) {
+                lineCandidates.push_back(interior);
+            }
+            break;
+        }
+        case ',':
+            if (!brackets.empty())
+                ++brackets.back().elements;
+            break;
+        default:
+            break;
+        }
+    }
+    finishLine(size);
+
+    std::sort(regions.begin(), regions.end(), [](const Utf8Range &left, const Utf8Range &right) {
+        return left.offset < right.offset;
+    });
+    std::vector<Utf8Range> merged;
+    for (const Utf8Range &region : regions) {
+        if (!merged.empty() && region.offset <= merged.back().offset + merged.back().length) {
+            Utf8Range &last = merged.back();
+            last.length = std::max(last.offset + last.length, region.offset + region.length)
+                          - last.offset;
+        } else {
+            merged.push_back(region);
+        }
+    }
+    return merged;
+}
+
+// Replaces everything but line breaks in the regions by spaces. Offsets and line numbers stay
+// the same and the brackets around the regions keep the structure intact.
+std::string neutralizedBuffer(std::string_view buffer, const std::vector<Utf8Range> &regions)
+{
+    std::string result(buffer);
+    for (const Utf8Range &region : regions) {
+        for (int i = region.offset; i < region.offset + region.length; ++i) {
+            if (result[i] != '\n')
+                result[i] = ' ';
+        }
+    }
+    return result;
+}
+
+std::vector<clang::tooling::Range> toClangRanges(const std::vector<Utf8Range> &ranges)
+{
+    std::vector<clang::tooling::Range> result;
+    result.reserve(ranges.size());
+    for (const Utf8Range &range : ranges)
+        result.emplace_back(unsigned(range.offset), unsigned(range.length));
+    return result;
+}
+} // namespace
+
+clang::format::FormatStyle indentationStyle(const clang::format::FormatStyle &style,
+                                            ReplacementsToKeep replacementsToKeep)
+{
+    clang::format::FormatStyle adjusted = style;
+    adjustFormatStyleForLineBreak(adjusted, replacementsToKeep);
+    return adjusted;
+}
+
+Utf8Replacements formatBuffer(std::string_view buffer,
+                              const clang::format::FormatStyle &style,
+                              const Utils::FilePath &filePath,
+                              const std::vector<Utf8Range> &ranges)
+{
+    if (ranges.empty())
+        return {};
+
+    const llvm::StringRef code(buffer.data(), buffer.size());
+    const std::string assumedFileName = filePath.toString().toStdString();
+    std::vector<clang::tooling::Range> clangRanges = toClangRanges(ranges);
+
+    clang::tooling::Replacements replacements = clang::format::sortIncludes(style,
+                                                                            code,
+                                                                            clangRanges,
+                                                                            assumedFileName);
+    auto changedCode = clang::tooling::applyAllReplacements(code, replacements);
+    QTC_ASSERT(changedCode, {
+        qDebug() << QString::fromStdString(llvm::toString(changedCode.takeError()));
+        return {};
+    });
+    clangRanges = clang::tooling::calculateRangesAfterReplacements(replacements, clangRanges);
+
+    clang::format::FormattingAttemptStatus status;
+    const clang::tooling::Replacements formatReplacements = reformat(style,
+                                                                     *changedCode,
+                                                                     clangRanges,
+                                                                     assumedFileName,
+                                                                     &status);
+    return toUtf8Replacements(replacements.merge(formatReplacements));
+}
+
+Utf8Replacements indentBuffer(std::string_view buffer,
+                              const clang::format::FormatStyle &style,
+                              const Utils::FilePath &filePath,
+                              const Utf8Range &lines,
+                              ReplacementsToKeep replacementsToKeep,
+                              int formatFrom)
+{
+    QTC_ASSERT(replacementsToKeep != ReplacementsToKeep::All, return {});
+
+    int rangeStart = lines.offset;
+    if (replacementsToKeep == ReplacementsToKeep::IndentAndBefore && formatFrom >= 0)
+        rangeStart = std::min(rangeStart, formatFrom);
+    const int rangeEnd = lines.offset + lines.length;
+
+    // Pathological regions are opaque: lines inside them keep their indentation, code before
+    // the lines is only formatted after them and everywhere else they are blanked out.
+    const std::vector<Utf8Range> regions = int(buffer.size()) >= minScannedBufferSize
+                                               ? pathologicalRegions(buffer)
+                                               : std::vector<Utf8Range>();
+    for (const Utf8Range &region : regions) {
+        if (overlaps(region, lines.offset, rangeEnd))
+            return {};
+        if (overlaps(region, rangeStart, lines.offset))
+            rangeStart = region.offset + region.length;
+    }
+    std::string neutralized;
+    if (!regions.empty()) {
+        neutralized = neutralizedBuffer(buffer, regions);
+        buffer = neutralized;
+    }
+
+    const std::vector<clang::tooling::Range> ranges{
+        {unsigned(rangeStart), unsigned(rangeEnd - rangeStart)}};
+
+    clang::format::FormattingAttemptStatus status;
+    const clang::tooling::Replacements replacements
+        = reformat(indentationStyle(style, replacementsToKeep),
+                   llvm::StringRef(buffer.data(), buffer.size()),
+                   ranges,
+                   filePath.toString().toStdString(),
+                   &status);
+    if (!status.FormatComplete)
+        return {};
+
+    Utf8Replacements filtered = filteredReplacements(buffer,
+                                                     replacements,
+                                                     lines.offset,
+                                                     lines.length,
+                                                     replacementsToKeep);
+    // Never touch the blanked out text.
+    Utils::erase(filtered, [&regions](const Utf8Replacement &replacement) {
+        return Utils::anyOf(regions, [&replacement](const Utf8Range &region) {
+            return overlaps(region, replacement.offset, replacement.offset + replacement.length);
+        });
+    });
+    return filtered;
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,63 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/filepath.h>
+
+#include <clang/Format/Format.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The formatting pipeline of the editor on plain UTF-8 buffers. Callers that do not have a
+// QTextDocument (refactoring tools, code generators, batch formatting) get the same results
+// as the editor without creating one. ClangFormatBaseIndenter is an adapter on top of this.
+// Only depends on Utils and clang-format, formatStyleForFile() in clangformatutils.h resolves
+// the style of the IDE for a file.
+
+namespace ClangFormat {
+
+enum class ReplacementsToKeep { OnlyIndent, IndentAndBefore, All };
+
+// Offsets and lengths are in bytes of the buffer that was passed in.
+struct Utf8Range
+{
+    int offset = 0;
+    int length = 0;
+};
+
+struct Utf8Replacement
+{
+    int offset = 0;
+    int length = 0;
+    std::string text;
+};
+
+using Utf8Replacements = std::vector<Utf8Replacement>;
+
+// The style that indentBuffer() passes to clang::format::reformat().
+clang::format::FormatStyle indentationStyle(const clang::format::FormatStyle &style,
+                                            ReplacementsToKeep replacementsToKeep);
+
+// Sorts the includes and formats the ranges completely.
+Utf8Replacements formatBuffer(std::string_view buffer,
+                              const clang::format::FormatStyle &style,
+                              const Utils::FilePath &filePath,
+                              const std::vector<Utf8Range> &ranges);
+
+// Returns the replacements for the lines in \a lines. OnlyIndent keeps the whitespace after
+// line breaks only, IndentAndBefore also formats the code from \a formatFrom up to the lines.
+// Returns nothing if clang-format could not complete, e.g. for unbalanced braces.
+// In buffers of 16 KiB and more, generated code that makes clang-format slow (overlong lines,
+// huge braced lists, very deep nesting) is opaque: it is blanked out for clang-format, and
+// lines inside it get nothing.
+Utf8Replacements indentBuffer(std::string_view buffer,
+                              const clang::format::FormatStyle &style,
+                              const Utils::FilePath &filePath,
+                              const Utf8Range &lines,
+                              ReplacementsToKeep replacementsToKeep,
+                              int formatFrom = -1);
+
+} // namespace ClangFormat
@@ -3,6 +3,8 @@
 
 #include "clangformatglobalconfigwidget.h"
 
+#include "clangformatbenchmark.h"
+#include "clangformatcalibration.h"
 #include "clangformatconfigwidget.h"
 #include "clangformatconstants.h"
 #include "clangformatfile.h"
@@ -61,6 +63,12 @@ private:
     void initCustomSettingsCheckBox();
     void initUseGlobalSettingsCheckBox();
     void initFileSizeThresholdSpinBox();
+    void initFileSizeCalibration();
+    void initSlowRequestThresholdSpinBox();
+    void initDocumentStateBudgetSpinBox();
+    void initIndentationEngineComboBox();
+    void initFormatWhileTypingDelaySpinBox();
+    void initFormatOnSaveRangesComboBox();
     void initCurrentProjectLabel();
 
     bool projectClangFormatFileExists();
@@ -74,9 +82,23 @@ private:
     QLabel *m_formattingModeLabel;
     QLabel *m_fileSizeThresholdLabel;
     QSpinBox *m_fileSizeThresholdSpinBox;
+    QCheckBox *m_calibrateFileSizeThreshold;
+    QSpinBox *m_latencyTargetSpinBox;
+    QLabel *m_calibrationBasis;
+    QLabel *m_slowRequestThresholdLabel;
+    QSpinBox *m_slowRequestThresholdSpinBox;
+    QLabel *m_documentStateBudgetLabel;
+    QSpinBox *m_documentStateBudgetSpinBox;
+    QLabel *m_indentationEngineLabel;
+    QComboBox *m_indentationEngine;
     QComboBox *m_indentingOrFormatting;
     QCheckBox *m_formatWhileTyping;
+    QLabel *m_formatWhileTypingDelayLabel;
+    QSpinBox *m_formatWhileTypingDelaySpinBox;
     QCheckBox *m_formatOnSave;
+    QCheckBox *m_applyFormattingInSlices;
+    QLabel *m_formatOnSaveRangesLabel;
+    QComboBox *m_formatOnSaveRanges;
     QCheckBox *m_useCustomSettingsCheckBox;
     QCheckBox *m_useGlobalSettings;
     InfoLabel *m_currentProjectLabel;
@@ -98,9 +120,52 @@ ClangFormatGlobalConfigWidget::ClangFormatGlobalConfigWidget(ICodeStylePreferenc
     m_fileSizeThresholdLabel->setToolTip(sizeThresholdToolTip);
     m_fileSizeThresholdSpinBox = new QSpinBox(this);
     m_fileSizeThresholdSpinBox->setToolTip(sizeThresholdToolTip);
+    const QString calibrationToolTip = Tr::tr(
+        "Measures how fast ClangFormat indents on this machine for each style and ignores\n"
+        "the files for which indenting a line is expected to take longer than this.\n"
+        "The fixed size is used until a style was measured.");
+    m_calibrateFileSizeThreshold = new QCheckBox(
+        Tr::tr("Adjust to machine speed, keystroke latency below:"));
+    m_calibrateFileSizeThreshold->setToolTip(calibrationToolTip);
+    m_latencyTargetSpinBox = new QSpinBox(this);
+    m_latencyTargetSpinBox->setToolTip(calibrationToolTip);
+    m_calibrationBasis = new QLabel(this);
+    const QString slowRequestToolTip = Tr::tr(
+        "Indentation and formatting requests that take longer are saved with their input\n"
+        "to the \"clang-format/slow-requests\" folder of the user settings, so that they\n"
+        "can be replayed with the clangformatreplay tool.");
+    m_slowRequestThresholdLabel = new QLabel(Tr::tr("Save requests slower than:"));
+    m_slowRequestThresholdLabel->setToolTip(slowRequestToolTip);
+    m_slowRequestThresholdSpinBox = new QSpinBox(this);
+    m_slowRequestThresholdSpinBox->setToolTip(slowRequestToolTip);
+    const QString documentStateBudgetToolTip = Tr::tr(
+        "The indenters of all open documents together keep at most this much cached state.\n"
+        "The documents that were not used for the longest time drop theirs first\n"
+        "and rebuild it when they are edited again.");
+    m_documentStateBudgetLabel = new QLabel(Tr::tr("Cache for open documents:"));
+    m_documentStateBudgetLabel->setToolTip(documentStateBudgetToolTip);
+    m_documentStateBudgetSpinBox = new QSpinBox(this);
+    m_documentStateBudgetSpinBox->setToolTip(documentStateBudgetToolTip);
+    m_indentationEngineLabel = new QLabel(Tr::tr("Indentation while typing:"));
+    m_indentationEngine = new QComboBox(this);
     m_indentingOrFormatting = new QComboBox(this);
     m_formatWhileTyping = new QCheckBox(Tr::tr("Format while typing"));
+    const QString formatWhileTypingDelayToolTip = Tr::tr(
+        "Typing ';' or '}' indents the current line immediately, but formats the code\n"
+        "in front of it only after the editor was idle for this long.\n"
+        "Several statements typed in a row are then formatted at once.");
+    m_formatWhileTypingDelayLabel = new QLabel(Tr::tr("Delay formatting while typing:"));
+    m_formatWhileTypingDelayLabel->setToolTip(formatWhileTypingDelayToolTip);
+    m_formatWhileTypingDelaySpinBox = new QSpinBox(this);
+    m_formatWhileTypingDelaySpinBox->setToolTip(formatWhileTypingDelayToolTip);
     m_formatOnSave = new QCheckBox(Tr::tr("Format edited code on file save"));
+    m_formatOnSaveRangesLabel = new QLabel(Tr::tr("Lines to format on save:"));
+    m_formatOnSaveRanges = new QComboBox(this);
+    m_applyFormattingInSlices = new QCheckBox(
+        Tr::tr("Keep the editor responsive while applying large formatting results"));
+    m_applyFormattingInSlices->setToolTip(
+        Tr::tr("Formatting results with many changes are applied bit by bit while the editor\n"
+               "is read-only, as a single undo step. Formatting on save is applied at once."));
     m_useCustomSettingsCheckBox = new QCheckBox(Tr::tr("Use custom settings"));
     m_useGlobalSettings = new QCheckBox(Tr::tr("Use global settings"));
     m_useGlobalSettings->hide();
@@ -124,10 +189,22 @@ ClangFormatGlobalConfigWidget::ClangFormatGlobalConfigWidget(ICodeStylePreferenc
             m_useGlobalSettings,
             Form {
                  m_formattingModeLabel, m_indentingOrFormatting, st, br,
-                 m_fileSizeThresholdLabel, m_fileSizeThresholdSpinBox, st, br
+                 m_indentationEngineLabel, m_indentationEngine, st, br,
+                 m_fileSizeThresholdLabel, m_fileSizeThresholdSpinBox, st, br,
+                 m_calibrateFileSizeThreshold, m_latencyTargetSpinBox, st, br,
+                 m_slowRequestThresholdLabel, m_slowRequestThresholdSpinBox, st, br,
+                 m_documentStateBudgetLabel, m_documentStateBudgetSpinBox, st, br
             },
+            m_calibrationBasis,
             m_formatWhileTyping,
+            Form {
+                 m_formatWhileTypingDelayLabel, m_formatWhileTypingDelaySpinBox, st, br
+            },
             m_formatOnSave,
+            Form {
+                 m_formatOnSaveRangesLabel, m_formatOnSaveRanges, st, br
+            },
+            m_applyFormattingInSlices,
             m_projectHasClangFormat,
             m_useCustomSettingsCheckBox,
             m_currentProjectLabel
@@ -145,11 +222,18 @@ ClangFormatGlobalConfigWidget::ClangFormatGlobalConfigWidget(ICodeStylePreferenc
     initCustomSettingsCheckBox();
     initUseGlobalSettingsCheckBox();
     initFileSizeThresholdSpinBox();
+    initFileSizeCalibration();
+    initSlowRequestThresholdSpinBox();
+    initDocumentStateBudgetSpinBox();
+    initIndentationEngineComboBox();
+    initFormatWhileTypingDelaySpinBox();
+    initFormatOnSaveRangesComboBox();
     initCurrentProjectLabel();
 
     if (project) {
         m_formatOnSave->hide();
         m_formatWhileTyping->hide();
+        m_applyFormattingInSlices->hide();
 
         m_useGlobalSettings->show();
         return;
@@ -171,6 +255,8 @@ void ClangFormatGlobalConfigWidget::initCheckBoxes()
             this, setEnableCheckBoxes);
 
     m_formatOnSave->setChecked(ClangFormatSettings::instance().formatOnSave());
+    m_applyFormattingInSlices->setChecked(
+        ClangFormatSettings::instance().applyFormattingInSlices());
     m_formatWhileTyping->setChecked(ClangFormatSettings::instance().formatWhileTyping());
 }
 
@@ -187,8 +273,10 @@ void ClangFormatGlobalConfigWidget::initIndentationOrFormattingCombobox()
         static_cast<int>(getProjectIndentationOrFormattingSettings(m_project)));
 
     connect(m_indentingOrFormatting, &QComboBox::currentIndexChanged, this, [this](int index) {
-        if (m_project)
+        if (m_project) {
             m_project->setNamedSettings(Constants::MODE_ID, index);
+            invalidateStyles();
+        }
     });
 }
 
@@ -219,6 +307,7 @@ void ClangFormatGlobalConfigWidget::initUseGlobalSettingsCheckBox()
     connect(m_useGlobalSettings, &QCheckBox::toggled,
             this, [this, enableProjectSettings] (bool checked) {
                 m_project->setNamedSettings(Constants::USE_GLOBAL_SETTINGS, checked);
+                invalidateStyles();
                 enableProjectSettings();
             });
 }
@@ -242,6 +331,144 @@ void ClangFormatGlobalConfigWidget::initFileSizeThresholdSpinBox()
     });
 }
 
+void ClangFormatGlobalConfigWidget::initFileSizeCalibration()
+{
+    m_calibrateFileSizeThreshold->setChecked(
+        ClangFormatSettings::instance().calibrateFileSizeThreshold());
+    m_latencyTargetSpinBox->setMinimum(1);
+    m_latencyTargetSpinBox->setMaximum(10 * 1000);
+    m_latencyTargetSpinBox->setSuffix(" ms");
+    m_latencyTargetSpinBox->setValue(ClangFormatSettings::instance().latencyTarget());
+    if (m_project) {
+        m_calibrateFileSizeThreshold->hide();
+        m_latencyTargetSpinBox->hide();
+        m_calibrationBasis->hide();
+        return;
+    }
+
+    const auto updateBasis = [this] {
+        m_calibrationBasis->setText(FileSizeCalibration::instance().basis());
+    };
+    updateBasis();
+    connect(&FileSizeCalibration::instance(), &FileSizeCalibration::changed, this, updateBasis);
+
+    const auto setEnabled = [this] {
+        const bool enabled = m_indentingOrFormatting->currentIndex()
+                             != static_cast<int>(ClangFormatSettings::Mode::Disable);
+        m_calibrateFileSizeThreshold->setEnabled(enabled);
+        m_latencyTargetSpinBox->setEnabled(enabled && m_calibrateFileSizeThreshold->isChecked());
+        m_calibrationBasis->setEnabled(enabled && m_calibrateFileSizeThreshold->isChecked());
+    };
+    setEnabled();
+    connect(m_calibrateFileSizeThreshold, &QCheckBox::toggled, this, setEnabled);
+    connect(m_indentingOrFormatting, &QComboBox::currentIndexChanged, this, setEnabled);
+}
+
+void ClangFormatGlobalConfigWidget::initSlowRequestThresholdSpinBox()
+{
+    m_slowRequestThresholdSpinBox->setMinimum(0);
+    m_slowRequestThresholdSpinBox->setMaximum(60 * 1000);
+    m_slowRequestThresholdSpinBox->setSuffix(" ms");
+    m_slowRequestThresholdSpinBox->setSpecialValueText(Tr::tr("Never"));
+    m_slowRequestThresholdSpinBox->setValue(ClangFormatSettings::instance().slowRequestThreshold());
+    if (m_project) {
+        m_slowRequestThresholdSpinBox->hide();
+        m_slowRequestThresholdLabel->hide();
+    }
+}
+
+void ClangFormatGlobalConfigWidget::initDocumentStateBudgetSpinBox()
+{
+    m_documentStateBudgetSpinBox->setMinimum(1);
+    m_documentStateBudgetSpinBox->setMaximum(64 * 1024);
+    m_documentStateBudgetSpinBox->setSuffix(" MB");
+    m_documentStateBudgetSpinBox->setValue(ClangFormatSettings::instance().documentStateBudget());
+    if (m_project) {
+        m_documentStateBudgetSpinBox->hide();
+        m_documentStateBudgetLabel->hide();
+    }
+}
+
+void ClangFormatGlobalConfigWidget::initIndentationEngineComboBox()
+{
+    m_indentationEngine->insertItem(ClangFormatSettings::ClangFormatEngine, Tr::tr("ClangFormat"));
+    m_indentationEngine->insertItem(ClangFormatSettings::NativeEngineVerified,
+                                    Tr::tr("Fast, verified by ClangFormat"));
+    m_indentationEngine->insertItem(ClangFormatSettings::NativeEngine, Tr::tr("Fast"));
+    m_indentationEngine->setToolTip(
+        Tr::tr("The fast indenter derives the indentation after Enter and electric characters "
+               "from the indentation options of the style, without running ClangFormat.\n"
+               "When verified, ClangFormat checks the result while the editor is idle and "
+               "differences are logged in the \"qtc.clangformat.indenter\" category."));
+    m_indentationEngine->setCurrentIndex(ClangFormatSettings::instance().indentationEngine());
+    if (m_project) {
+        m_indentationEngine->hide();
+        m_indentationEngineLabel->hide();
+    }
+
+    const auto setEnabled = [this](int index) {
+        const bool enabled = index != static_cast<int>(ClangFormatSettings::Mode::Disable);
+        m_indentationEngineLabel->setEnabled(enabled);
+        m_indentationEngine->setEnabled(enabled);
+    };
+    setEnabled(m_indentingOrFormatting->currentIndex());
+    connect(m_indentingOrFormatting, &QComboBox::currentIndexChanged, this, setEnabled);
+}
+
+void ClangFormatGlobalConfigWidget::initFormatWhileTypingDelaySpinBox()
+{
+    m_formatWhileTypingDelaySpinBox->setMinimum(0);
+    m_formatWhileTypingDelaySpinBox->setMaximum(10 * 1000);
+    m_formatWhileTypingDelaySpinBox->setSingleStep(100);
+    m_formatWhileTypingDelaySpinBox->setSuffix(" ms");
+    m_formatWhileTypingDelaySpinBox->setSpecialValueText(Tr::tr("No delay"));
+    m_formatWhileTypingDelaySpinBox->setValue(
+        ClangFormatSettings::instance().formatWhileTypingDelay());
+    if (m_project) {
+        m_formatWhileTypingDelaySpinBox->hide();
+        m_formatWhileTypingDelayLabel->hide();
+        return;
+    }
+
+    const auto setEnabled = [this] {
+        const bool enabled = m_formatWhileTyping->isEnabled() && m_formatWhileTyping->isChecked();
+        m_formatWhileTypingDelayLabel->setEnabled(enabled);
+        m_formatWhileTypingDelaySpinBox->setEnabled(enabled);
+    };
+    setEnabled();
+    connect(m_formatWhileTyping, &QCheckBox::toggled, this, setEnabled);
+    connect(m_indentingOrFormatting, &QComboBox::currentIndexChanged, this, setEnabled);
+}
+
+void ClangFormatGlobalConfigWidget::initFormatOnSaveRangesComboBox()
+{
+    m_formatOnSaveRanges->insertItem(ClangFormatSettings::EditedLines,
+                                     Tr::tr("Edited since the last save"));
+    m_formatOnSaveRanges->insertItem(ClangFormatSettings::ChangedSinceIndex,
+                                     Tr::tr("Changed against the Git index"));
+    m_formatOnSaveRanges->insertItem(ClangFormatSettings::ChangedSinceHead,
+                                     Tr::tr("Changed against Git HEAD"));
+    m_formatOnSaveRanges->setToolTip(
+        Tr::tr("The Git based choices format the lines that git clang-format would format,\n"
+               "using the local repository only. Files outside of a Git work tree\n"
+               "format the lines edited since the last save."));
+    m_formatOnSaveRanges->setCurrentIndex(ClangFormatSettings::instance().formatOnSaveRanges());
+    if (m_project) {
+        m_formatOnSaveRanges->hide();
+        m_formatOnSaveRangesLabel->hide();
+        return;
+    }
+
+    const auto setEnabled = [this] {
+        const bool enabled = m_formatOnSave->isEnabled() && m_formatOnSave->isChecked();
+        m_formatOnSaveRangesLabel->setEnabled(enabled);
+        m_formatOnSaveRanges->setEnabled(enabled);
+    };
+    setEnabled();
+    connect(m_formatOnSave, &QCheckBox::toggled, this, setEnabled);
+    connect(m_indentingOrFormatting, &QComboBox::currentIndexChanged, this, setEnabled);
+}
+
 void ClangFormatGlobalConfigWidget::initCurrentProjectLabel()
 {
     auto setCurrentProjectLabelVisible = [this]() {
@@ -327,6 +554,7 @@ void ClangFormatGlobalConfigWidget::initCustomSettingsCheckBox()
             [this, setTemporarilyReadOnly](bool checked) {
                 if (m_project) {
                     m_project->setNamedSettings(Constants::USE_CUSTOM_SETTINGS_ID, checked);
+                    invalidateStyles();
                 } else {
                     ClangFormatSettings::instance().setUseCustomSettings(checked);
                     setTemporarilyReadOnly();
@@ -344,12 +572,22 @@ void ClangFormatGlobalConfigWidget::apply()
 {
     ClangFormatSettings &settings = ClangFormatSettings::instance();
     settings.setFormatOnSave(m_formatOnSave->isChecked());
+    settings.setFormatOnSaveRanges(static_cast<ClangFormatSettings::FormatOnSaveRanges>(
+        m_formatOnSaveRanges->currentIndex()));
     settings.setFormatWhileTyping(m_formatWhileTyping->isChecked());
     if (!m_project) {
         settings.setMode(
             static_cast<ClangFormatSettings::Mode>(m_indentingOrFormatting->currentIndex()));
         settings.setUseCustomSettings(m_useCustomSettingsCheckBox->isChecked());
         settings.setFileSizeThreshold(m_fileSizeThresholdSpinBox->value());
+        settings.setCalibrateFileSizeThreshold(m_calibrateFileSizeThreshold->isChecked());
+        settings.setLatencyTarget(m_latencyTargetSpinBox->value());
+        settings.setSlowRequestThreshold(m_slowRequestThresholdSpinBox->value());
+        settings.setDocumentStateBudget(m_documentStateBudgetSpinBox->value());
+        settings.setApplyFormattingInSlices(m_applyFormattingInSlices->isChecked());
+        settings.setFormatWhileTypingDelay(m_formatWhileTypingDelaySpinBox->value());
+        settings.setIndentationEngine(static_cast<ClangFormatSettings::IndentationEngine>(
+            m_indentationEngine->currentIndex()));
         m_useCustomSettings = m_useCustomSettingsCheckBox->isChecked();
     }
     settings.write();
@@ -422,6 +660,7 @@ class ClangFormatStyleFactory final : public CppCodeStylePreferencesFactory
 public:
     Indenter *createIndenter(QTextDocument *doc) const final
     {
+        Benchmark::firstIndenterCreated();
         return new ClangFormatForwardingIndenter(doc);
     }
 
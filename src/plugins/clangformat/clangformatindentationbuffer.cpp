@@ -0,0 +1,283 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatindentationbuffer.h"
+
+#include "clangformattextscanner.h"
+
+#include <utils/qtcassert.h>
+#include <utils/textutils.h>
+
+#include <QTextDocument>
+
+namespace ClangFormat::Internal {
+
+namespace {
+
+enum class CharacterContext {
+    AfterComma,
+    LastAfterComma,
+    NewStatementOrContinuation,
+    IfOrElseWithoutScope,
+    Unknown
+};
+
+QChar findFirstNonWhitespaceCharacter(const QTextBlock &currentBlock)
+{
+    DocumentScanner scanner(currentBlock.document(), currentBlock.position());
+    if (!scanner.isValid())
+        return QChar::Null;
+    do {
+        if (!scanner.character().isSpace())
+            return scanner.character();
+    } while (scanner.next());
+    return QChar::Null;
+}
+
+int findMatchingOpeningParen(const QTextBlock &blockEndingWithClosingParen)
+{
+    const BlockText text(blockEndingWithClosingParen);
+    DocumentScanner scanner(blockEndingWithClosingParen.document(),
+                                      blockEndingWithClosingParen.position()
+                                          + int(text.view().lastIndexOf(')')));
+    int parenBalance = 1;
+
+    while (parenBalance > 0 && scanner.previous()) {
+        if (scanner.character() == ')')
+            ++parenBalance;
+        else if (scanner.character() == '(')
+            --parenBalance;
+    }
+
+    if (parenBalance == 0)
+        return scanner.position();
+
+    return -1;
+}
+
+bool comesDirectlyAfterIf(const QTextDocument *doc, int pos)
+{
+    DocumentScanner scanner(doc, pos);
+    if (!scanner.previous())
+        return false;
+    while (scanner.position() > 0 && scanner.character().isSpace())
+        scanner.previous();
+    if (scanner.position() <= 0 || scanner.character() != 'f')
+        return false;
+    scanner.previous();
+    return scanner.character() == 'i';
+}
+
+CharacterContext characterContext(const QTextBlock &currentBlock,
+                                  const QTextBlock &previousNonEmptyBlock)
+{
+    const BlockText previousText(previousNonEmptyBlock);
+    const QStringView prevLineText = previousText.trimmed();
+    if (prevLineText.isEmpty())
+        return CharacterContext::NewStatementOrContinuation;
+
+    const QChar firstNonWhitespaceChar = findFirstNonWhitespaceCharacter(currentBlock);
+    if (prevLineText.endsWith(',')) {
+        // We don't need to add comma in case it's the last argument.
+        if (firstNonWhitespaceChar == '}' || firstNonWhitespaceChar == ')')
+            return CharacterContext::LastAfterComma;
+        return CharacterContext::AfterComma;
+    }
+
+    if (prevLineText.endsWith(u"else"))
+        return CharacterContext::IfOrElseWithoutScope;
+    if (prevLineText.endsWith(')')) {
+        const int pos = findMatchingOpeningParen(previousNonEmptyBlock);
+        if (pos >= 0 && comesDirectlyAfterIf(previousNonEmptyBlock.document(), pos))
+            return CharacterContext::IfOrElseWithoutScope;
+    }
+
+    return CharacterContext::NewStatementOrContinuation;
+}
+
+bool nextBlockExistsAndEmpty(const QTextBlock &currentBlock)
+{
+    QTextBlock nextBlock = currentBlock.next();
+    if (!nextBlock.isValid() || nextBlock.position() == currentBlock.position())
+        return false;
+
+    return isBlankBlock(nextBlock);
+}
+
+QByteArray dummyTextForContext(CharacterContext context, bool closingBraceBlock)
+{
+    if (closingBraceBlock && context == CharacterContext::NewStatementOrContinuation)
+        return QByteArray();
+
+    switch (context) {
+    case CharacterContext::AfterComma:
+        return "a,";
+    case CharacterContext::LastAfterComma:
+        return "a";
+    case CharacterContext::IfOrElseWithoutScope:
+        return ";";
+    case CharacterContext::NewStatementOrContinuation:
+        return "/**/";
+    case CharacterContext::Unknown:
+    default:
+        QTC_ASSERT(false, return "";);
+    }
+}
+
+// Add extra text in case of the empty line or the line starting with ')'.
+// Track such extra pieces of text in isInsideDummyTextInLine().
+int forceIndentWithExtraText(QByteArray &buffer,
+                             CharacterContext &charContext,
+                             const QTextBlock &block,
+                             bool secondTry)
+{
+    if (!block.isValid())
+        return 0;
+
+    const BlockText text(block);
+    const QStringView blockText = text.view();
+    const int firstNonWhitespace = text.firstNonSpace();
+    int utf8Offset = Utils::Text::utf8NthLineOffset(block.document(),
+                                                    buffer,
+                                                    block.blockNumber() + 1);
+    if (firstNonWhitespace >= 0)
+        utf8Offset += firstNonWhitespace;
+    else
+        utf8Offset += blockText.length();
+
+    const bool closingParenBlock = firstNonWhitespace >= 0
+                                   && blockText.at(firstNonWhitespace) == ')';
+    const bool closingBraceBlock = firstNonWhitespace >= 0
+                                   && blockText.at(firstNonWhitespace) == '}';
+
+    int extraLength = 0;
+    QByteArray dummyText;
+    if (firstNonWhitespace < 0 && charContext != CharacterContext::Unknown
+        && nextBlockExistsAndEmpty(block)) {
+        // If the next line is also empty it's safer to use a comment line.
+        dummyText = "//";
+    } else if (firstNonWhitespace < 0 || closingParenBlock || closingBraceBlock) {
+        if (charContext == CharacterContext::LastAfterComma) {
+            charContext = CharacterContext::AfterComma;
+        } else if (charContext == CharacterContext::Unknown || firstNonWhitespace >= 0) {
+            QTextBlock lastBlock = reverseFindLastEmptyBlock(block);
+            if (lastBlock.position() > 0)
+                lastBlock = lastBlock.previous();
+
+            // If we don't know yet the dummy text, let's guess it and use for this line and before.
+            charContext = characterContext(block, lastBlock);
+        }
+
+        dummyText = dummyTextForContext(charContext, closingBraceBlock);
+    }
+
+    // A comment at the end of the line appears to prevent clang-format from removing line breaks.
+    if (dummyText == "/**/" || dummyText.isEmpty()) {
+        if (block.previous().isValid()) {
+            const int prevEndOffset = Utils::Text::utf8NthLineOffset(block.document(), buffer,
+                    block.blockNumber()) + block.previous().length() - 1;
+            buffer.insert(prevEndOffset, " //");
+            extraLength += 3;
+        }
+    }
+    buffer.insert(utf8Offset + extraLength, dummyText);
+    extraLength += dummyText.length();
+
+    if (secondTry) {
+        int nextLinePos = buffer.indexOf('\n', utf8Offset);
+        if (nextLinePos < 0)
+            nextLinePos = buffer.size() - 1;
+
+        if (nextLinePos > 0) {
+            // If first try was not successful try to put ')' in the end of the line to close possibly
+            // unclosed parenthesis.
+            // TODO: Does it help to add different endings depending on the context?
+            buffer.insert(nextLinePos, ')');
+            extraLength += 1;
+        }
+    }
+
+    return extraLength;
+}
+
+bool isInsideDummyTextInLine(QStringView originalLine, QStringView modifiedLine, int column)
+{
+    // Detect the cases when we have inserted extra text into the line to get the indentation.
+    return originalLine.length() < modifiedLine.length() && column != modifiedLine.length() + 1
+           && (column > originalLine.length() || originalLine.trimmed().isEmpty()
+               || !modifiedLine.startsWith(originalLine));
+}
+
+} // namespace
+
+QTextBlock reverseFindLastEmptyBlock(QTextBlock start)
+{
+    if (start.position() > 0) {
+        start = start.previous();
+        while (start.position() > 0 && isBlankBlock(start))
+            start = start.previous();
+        if (!isBlankBlock(start))
+            start = start.next();
+    }
+    return start;
+}
+
+int addIndentationDummyText(QByteArray &buffer,
+                            const QTextBlock &startBlock,
+                            const QTextBlock &endBlock,
+                            bool secondTry)
+{
+    const QTextDocument *doc = startBlock.document();
+    CharacterContext currentCharContext = CharacterContext::Unknown;
+    int extraLength = 0;
+    // Iterate backwards to reuse the same dummy text for all empty lines.
+    for (int index = endBlock.blockNumber(); index >= startBlock.blockNumber(); --index) {
+        extraLength += forceIndentWithExtraText(buffer,
+                                                currentCharContext,
+                                                doc->findBlockByNumber(index),
+                                                secondTry);
+    }
+    return extraLength;
+}
+
+QByteArray documentBuffer(const QTextDocument *doc)
+{
+    // The scanners of the request see the same text.
+    return currentDocumentText(doc).toUtf8();
+}
+
+Utils::Text::Replacements utf16Replacements(const QTextDocument *doc,
+                                            const QByteArray &utf8Buffer,
+                                            const Utf8Replacements &replacements)
+{
+    Utils::Text::Replacements convertedReplacements;
+    convertedReplacements.reserve(replacements.size());
+
+    for (const Utf8Replacement &replacement : replacements) {
+        Utils::LineColumn lineColUtf16 = Utils::Text::utf16LineColumn(utf8Buffer,
+                                                                      replacement.offset);
+        if (!lineColUtf16.isValid())
+            continue;
+
+        const QString lineText = doc->findBlockByNumber(lineColUtf16.line - 1).text();
+        const QString bufferLineText
+            = Utils::Text::utf16LineTextInUtf8Buffer(utf8Buffer, replacement.offset);
+        if (isInsideDummyTextInLine(lineText, bufferLineText, lineColUtf16.column))
+            continue;
+
+        lineColUtf16.column = std::min(lineColUtf16.column, int(lineText.length()) + 1);
+
+        const int utf16Offset = Utils::Text::positionInText(doc,
+                                                            lineColUtf16.line,
+                                                            lineColUtf16.column);
+        const int utf16Length
+            = QString::fromUtf8(utf8Buffer.mid(replacement.offset, replacement.length)).size();
+        convertedReplacements.emplace_back(utf16Offset,
+                                           utf16Length,
+                                           QString::fromStdString(replacement.text));
+    }
+
+    return convertedReplacements;
+}
+
+} // namespace ClangFormat::Internal
@@ -0,0 +1,41 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include "clangformatformatter.h"
+
+#include <utils/textutils.h>
+
+#include <QByteArray>
+#include <QTextBlock>
+
+// Prepares the buffer that ClangFormatBaseIndenter passes to indentBuffer() when only the
+// indentation is requested, and converts the results back to the document. Depends on QtGui
+// and Utils only, so that the clangformatfuzzer and clangformatreplay tools run the same code
+// as the editor.
+
+namespace ClangFormat::Internal {
+
+// Returns the first of the blank blocks before \a start, or \a start.
+QTextBlock reverseFindLastEmptyBlock(QTextBlock start);
+
+// Inserts dummy text into \a buffer, the UTF-8 text of the document, for the blocks from
+// \a startBlock to \a endBlock that are empty or start with ')' or '}', so that clang-format
+// indents them. Returns the number of bytes inserted. The second try additionally closes a
+// possibly unclosed parenthesis at the end of each line.
+int addIndentationDummyText(QByteArray &buffer,
+                            const QTextBlock &startBlock,
+                            const QTextBlock &endBlock,
+                            bool secondTry);
+
+// The UTF-8 text of the document that is passed to clang-format.
+QByteArray documentBuffer(const QTextDocument *doc);
+
+// Converts replacements on \a utf8Buffer, the documentBuffer() of \a doc with dummy text
+// inserted, to positions in the document. Replacements inside the dummy text are dropped.
+Utils::Text::Replacements utf16Replacements(const QTextDocument *doc,
+                                            const QByteArray &utf8Buffer,
+                                            const Utf8Replacements &replacements);
+
+} // namespace ClangFormat::Internal
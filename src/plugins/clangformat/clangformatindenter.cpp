@@ -2,7 +2,11 @@
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
 
 #include "clangformatindenter.h"
+#include "clangformatbenchmark.h"
+#include "clangformatcalibration.h"
+#include "clangformatchangedlines.h"
 #include "clangformatsettings.h"
+#include "clangformatstatistics.h"
 #include "clangformatutils.h"
 
 #include <coreplugin/icore.h>
@@ -58,9 +62,40 @@ static bool isBeautifierOnSaveActivated()
     return activated;
 }
 
+// How long the editor has to be idle before the lines changed against Git are computed.
+const int changedLinesDelayMs = 1000;
+
 ClangFormatIndenter::ClangFormatIndenter(QTextDocument *doc)
     : ClangFormatBaseIndenter(doc)
-{}
+{
+    m_changedLinesTimer.setSingleShot(true);
+    m_changedLinesTimer.setInterval(changedLinesDelayMs);
+    QObject::connect(&m_changedLinesTimer, &QTimer::timeout, [this] {
+        if (const std::optional<GitDiffBase> base = gitDiffBase())
+            prefetchChangedLines(m_fileName, *base, m_doc->revision(), m_doc->toPlainText());
+    });
+    QObject::connect(m_doc, &QTextDocument::contentsChanged, &m_changedLinesTimer, [this] {
+        // Runs for every keystroke, the complete check waits for the timeout.
+        const ClangFormatSettings &settings = ClangFormatSettings::instance();
+        if (settings.formatOnSave()
+            && settings.formatOnSaveRanges() != ClangFormatSettings::EditedLines) {
+            m_changedLinesTimer.start();
+        }
+    });
+}
+
+ClangFormatIndenter::~ClangFormatIndenter()
+{
+    releaseChangedLines(m_fileName);
+}
+
+void ClangFormatIndenter::setFileName(const Utils::FilePath &fileName)
+{
+    releaseChangedLines(m_fileName);
+    ClangFormatBaseIndenter::setFileName(fileName);
+    if (const std::optional<GitDiffBase> base = gitDiffBase())
+        prefetchGitBase(m_fileName, *base);
+}
 
 bool ClangFormatIndenter::formatCodeInsteadOfIndent() const
 {
@@ -121,37 +156,161 @@ bool ClangFormatIndenter::formatOnSave() const
            && formatCodeInsteadOfIndent();
 }
 
+std::optional<GitDiffBase> ClangFormatIndenter::gitDiffBase() const
+{
+    if (m_fileName.isEmpty() || !formatOnSave())
+        return {};
+    switch (ClangFormatSettings::instance().formatOnSaveRanges()) {
+    case ClangFormatSettings::ChangedSinceIndex:
+        return GitDiffBase::Index;
+    case ClangFormatSettings::ChangedSinceHead:
+        return GitDiffBase::Head;
+    case ClangFormatSettings::EditedLines:
+        break;
+    }
+    return {};
+}
+
+RangesInLines ClangFormatIndenter::rangesToFormatOnSave(const RangesInLines &editedRanges)
+{
+    const std::optional<GitDiffBase> base = gitDiffBase();
+    if (!base)
+        return editedRanges;
+    // Files outside of a Git work tree keep formatting what was edited, as do saves before
+    // git answered.
+    return changedLines(m_fileName, *base, m_doc->revision(), m_doc->toPlainText())
+        .value_or(editedRanges);
+}
+
+qint64 ClangFormatIndenter::cachedStateBytes() const
+{
+    return ClangFormatBaseIndenter::cachedStateBytes() + changedLinesBytes(m_fileName);
+}
+
+void ClangFormatIndenter::releaseCachedState()
+{
+    ClangFormatBaseIndenter::releaseCachedState();
+    releaseChangedLines(m_fileName);
+}
+
 bool ClangFormatIndenter::formatWhileTyping() const
 {
     return ClangFormatSettings::instance().formatWhileTyping() && formatCodeInsteadOfIndent();
 }
 
+int ClangFormatIndenter::formatWhileTypingDelay() const
+{
+    return ClangFormatSettings::instance().formatWhileTypingDelay();
+}
+
 // ClangFormatIndenterWrapper
 
+// How long the indenter that is not currently routed to is kept around.
+const int inactiveIndenterTimeoutMs = 60 * 1000;
+
 ClangFormatForwardingIndenter::ClangFormatForwardingIndenter(QTextDocument *doc)
     : TextEditor::Indenter(doc)
-    , m_clangFormatIndenter(std::make_unique<ClangFormatIndenter>(doc))
-    , m_cppIndenter(CppEditor::createCppQtStyleIndenter(doc))
 {}
 
-ClangFormatForwardingIndenter::~ClangFormatForwardingIndenter() = default;
+ClangFormatForwardingIndenter::~ClangFormatForwardingIndenter()
+{
+    if (m_clangFormatIndenter)
+        Benchmark::indenterReleased(Benchmark::IndenterKind::ClangFormat);
+    if (m_cppIndenter)
+        Benchmark::indenterReleased(Benchmark::IndenterKind::BuiltIn);
+}
 
 void ClangFormatForwardingIndenter::setFileName(const Utils::FilePath &fileName)
 {
     m_fileName = fileName;
-    m_clangFormatIndenter->setFileName(fileName);
-    m_cppIndenter->setFileName(fileName);
+    if (m_clangFormatIndenter)
+        m_clangFormatIndenter->setFileName(fileName);
+    if (m_cppIndenter)
+        m_cppIndenter->setFileName(fileName);
+}
+
+TextEditor::Indenter *ClangFormatForwardingIndenter::clangFormatIndenter() const
+{
+    if (!m_clangFormatIndenter) {
+        m_clangFormatIndenter = std::make_unique<ClangFormatIndenter>(m_doc);
+        m_clangFormatIndenter->setFileName(m_fileName);
+        if (m_preferences)
+            m_clangFormatIndenter->setCodeStylePreferences(m_preferences);
+        Benchmark::indenterCreated(Benchmark::IndenterKind::ClangFormat);
+    }
+    m_clangFormatIndenterLastUsed.start();
+    static_cast<ClangFormatIndenter *>(m_clangFormatIndenter.get())->markRecentlyUsed();
+    return m_clangFormatIndenter.get();
+}
+
+TextEditor::Indenter *ClangFormatForwardingIndenter::cppIndenter() const
+{
+    if (!m_cppIndenter) {
+        m_cppIndenter.reset(CppEditor::createCppQtStyleIndenter(m_doc));
+        m_cppIndenter->setFileName(m_fileName);
+        if (m_preferences)
+            m_cppIndenter->setCodeStylePreferences(m_preferences);
+        Benchmark::indenterCreated(Benchmark::IndenterKind::BuiltIn);
+    }
+    m_cppIndenterLastUsed.start();
+    return m_cppIndenter.get();
+}
+
+void ClangFormatForwardingIndenter::releaseClangFormatIndenterIfUnused() const
+{
+    if (m_clangFormatIndenter
+        && m_clangFormatIndenterLastUsed.hasExpired(inactiveIndenterTimeoutMs)) {
+        m_clangFormatIndenter.reset();
+        Benchmark::indenterReleased(Benchmark::IndenterKind::ClangFormat);
+    }
+}
+
+void ClangFormatForwardingIndenter::releaseCppIndenterIfUnused() const
+{
+    if (m_cppIndenter && m_cppIndenterLastUsed.hasExpired(inactiveIndenterTimeoutMs)) {
+        m_cppIndenter.reset();
+        Benchmark::indenterReleased(Benchmark::IndenterKind::BuiltIn);
+    }
+}
+
+static int fileSizeThresholdFor(const Utils::FilePath &fileName)
+{
+    const ClangFormatSettings &settings = ClangFormatSettings::instance();
+    if (settings.calibrateFileSizeThreshold()) {
+        const int calibrated = FileSizeCalibration::instance().thresholdFor(fileName);
+        if (calibrated > 0)
+            return calibrated;
+    }
+    return settings.fileSizeThreshold();
+}
+
+void ClangFormatForwardingIndenter::recordRoute(int route) const
+{
+    // currentIndenter() runs for every request, the statistics only count the changes.
+    if (route == m_lastRoute)
+        return;
+    m_lastRoute = route;
+    Statistics::recordRoute(m_doc, m_fileName, Statistics::Route(route));
 }
 
 TextEditor::Indenter *ClangFormatForwardingIndenter::currentIndenter() const
 {
     ClangFormatSettings::Mode mode = getCurrentIndentationOrFormattingSettings(m_fileName);
 
-    if (mode == ClangFormatSettings::Disable
-        || m_fileName.fileSize() >= ClangFormatSettings::instance().fileSizeThreshold() * 1024)
-        return m_cppIndenter.get();
+    if (mode == ClangFormatSettings::Disable) {
+        recordRoute(int(Statistics::Route::BuiltInDisabled));
+        releaseClangFormatIndenterIfUnused();
+        return cppIndenter();
+    }
+    if (m_fileName.fileSize() >= fileSizeThresholdFor(m_fileName) * 1024) {
+        recordRoute(int(Statistics::Route::BuiltInFileSize));
+        releaseClangFormatIndenterIfUnused();
+        return cppIndenter();
+    }
 
-    return m_clangFormatIndenter.get();
+    recordRoute(int(Statistics::Route::ClangFormat));
+    releaseCppIndenterIfUnused();
+    return clangFormatIndenter();
 }
 
 bool ClangFormatForwardingIndenter::isElectricCharacter(const QChar &ch) const
@@ -162,6 +321,8 @@ bool ClangFormatForwardingIndenter::isElectricCharacter(const QChar &ch) const
 void ClangFormatForwardingIndenter::setCodeStylePreferences(
     TextEditor::ICodeStylePreferences *preferences)
 {
+    // Remembered for the indenter that gets created later.
+    m_preferences = preferences;
     currentIndenter()->setCodeStylePreferences(preferences);
 }
 
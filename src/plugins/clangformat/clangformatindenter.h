@@ -4,22 +4,39 @@
 #pragma once
 
 #include "clangformatbaseindenter.h"
+#include "clangformatchangedlines.h"
 
 #include <texteditor/tabsettings.h>
 
+#include <QElapsedTimer>
+#include <QTimer>
+
 namespace ClangFormat {
 
 class ClangFormatIndenter final : public ClangFormatBaseIndenter
 {
 public:
     ClangFormatIndenter(QTextDocument *doc);
+    ~ClangFormatIndenter() override;
+
+    void setFileName(const Utils::FilePath &fileName) override;
     std::optional<TextEditor::TabSettings> tabSettings() const override;
     bool formatOnSave() const override;
 
 private:
     bool formatCodeInsteadOfIndent() const override;
     bool formatWhileTyping() const override;
+    int formatWhileTypingDelay() const override;
     int lastSaveRevision() const override;
+    TextEditor::RangesInLines rangesToFormatOnSave(
+        const TextEditor::RangesInLines &editedRanges) override;
+    qint64 cachedStateBytes() const override;
+    void releaseCachedState() override;
+    std::optional<GitDiffBase> gitDiffBase() const;
+
+    // Computes the lines that changed against Git once the editor is idle, so that saving
+    // does not have to wait for it.
+    QTimer m_changedLinesTimer;
 };
 
 class ClangFormatForwardingIndenter : public TextEditor::Indenter
@@ -62,9 +79,20 @@ public:
 
 private:
     TextEditor::Indenter *currentIndenter() const;
+    TextEditor::Indenter *clangFormatIndenter() const;
+    TextEditor::Indenter *cppIndenter() const;
+    void releaseClangFormatIndenterIfUnused() const;
+    void releaseCppIndenterIfUnused() const;
+    void recordRoute(int route) const;
 
-    std::unique_ptr<TextEditor::Indenter> m_clangFormatIndenter;
-    std::unique_ptr<TextEditor::Indenter> m_cppIndenter;
+    // Both indenters are created on first use only, and the one that is not routed to
+    // is released again after a while, see currentIndenter().
+    mutable std::unique_ptr<TextEditor::Indenter> m_clangFormatIndenter;
+    mutable std::unique_ptr<TextEditor::Indenter> m_cppIndenter;
+    mutable QElapsedTimer m_clangFormatIndenterLastUsed;
+    mutable QElapsedTimer m_cppIndenterLastUsed;
+    mutable int m_lastRoute = -1; // a Statistics::Route, recorded when it changes
+    TextEditor::ICodeStylePreferences *m_preferences = nullptr;
 };
 
 } // namespace ClangFormat
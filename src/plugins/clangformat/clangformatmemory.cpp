@@ -0,0 +1,129 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatmemory.h"
+
+#include <QFile>
+#include <QList>
+#include <QLocale>
+#include <QMap>
+#include <QStringList>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+namespace ClangFormat::Memory {
+
+namespace {
+
+struct Cache
+{
+    const void *owner = nullptr;
+    QString name;
+    SizeFunction size;
+};
+
+QList<Cache> &caches()
+{
+    static QList<Cache> caches;
+    return caches;
+}
+
+#if defined(Q_OS_LINUX)
+// The value of a "Name:   1234 kB" line of the smaps files, in bytes.
+qint64 smapsValue(const QByteArray &smaps, const QByteArray &name)
+{
+    const int start = smaps.indexOf('\n' + name + ':');
+    if (start < 0)
+        return -1;
+    const int end = smaps.indexOf('\n', start + 1);
+    const QByteArray value = smaps.mid(start + name.size() + 2, end - start - name.size() - 2)
+                                 .trimmed();
+    bool ok = false;
+    const qint64 kilobytes = value.left(value.indexOf(' ')).toLongLong(&ok);
+    return ok ? kilobytes * 1024 : -1;
+}
+#endif
+
+QString formatBytes(qint64 bytes)
+{
+    if (bytes < 0)
+        return QString("unknown");
+    return QLocale::c().formattedDataSize(bytes);
+}
+
+} // namespace
+
+ProcessMemory processMemory()
+{
+    ProcessMemory result;
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(),
+                             reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&counters),
+                             sizeof(counters))) {
+        result.residentBytes = qint64(counters.WorkingSetSize);
+        result.privateBytes = qint64(counters.PrivateUsage);
+    }
+#elif defined(Q_OS_LINUX)
+    // The files of procfs have no size, QFile::readAll() reads until the end anyway.
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> pages = statm.readAll().split(' ');
+        if (pages.size() > 1)
+            result.residentBytes = pages.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+    // Since Linux 4.14, summing up all mappings of /proc/self/smaps is much slower.
+    QFile smapsRollup("/proc/self/smaps_rollup");
+    if (smapsRollup.open(QIODevice::ReadOnly)) {
+        const QByteArray smaps = '\n' + smapsRollup.readAll();
+        const qint64 clean = smapsValue(smaps, "Private_Clean");
+        const qint64 dirty = smapsValue(smaps, "Private_Dirty");
+        if (clean >= 0 && dirty >= 0)
+            result.privateBytes = clean + dirty;
+    }
+#endif
+    return result;
+}
+
+void addCache(const void *owner, const QString &name, const SizeFunction &size)
+{
+    caches().append({owner, name, size});
+}
+
+void removeCache(const void *owner)
+{
+    caches().removeIf([owner](const Cache &cache) { return cache.owner == owner; });
+}
+
+QString report()
+{
+    struct Total
+    {
+        int count = 0;
+        qint64 bytes = 0;
+    };
+    QMap<QString, Total> totals;
+    for (const Cache &cache : std::as_const(caches())) {
+        Total &total = totals[cache.name];
+        ++total.count;
+        total.bytes += cache.size();
+    }
+
+    const ProcessMemory process = processMemory();
+    QStringList lines{QString("Process: %1 resident, %2 private")
+                          .arg(formatBytes(process.residentBytes),
+                               formatBytes(process.privateBytes))};
+    for (auto it = totals.cbegin(); it != totals.cend(); ++it) {
+        lines.append(QString("%1: %2 in %3 instance(s)")
+                         .arg(it.key(), formatBytes(it->bytes))
+                         .arg(it->count));
+    }
+    return lines.join('\n');
+}
+
+} // namespace ClangFormat::Memory
@@ -0,0 +1,36 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <QString>
+
+#include <functional>
+
+// Attributes the memory of long sessions to the caches of the plugin. Only depends on QtCore,
+// so that the tools can report the process memory as well.
+
+namespace ClangFormat::Memory {
+
+// -1 where the platform does not tell.
+struct ProcessMemory
+{
+    qint64 residentBytes = -1;
+    // Not shared with other processes, Private_Clean and Private_Dirty on Linux.
+    qint64 privateBytes = -1;
+};
+
+// Reads /proc/self/statm and /proc/self/smaps_rollup on Linux, uses GetProcessMemoryInfo()
+// on Windows.
+ProcessMemory processMemory();
+
+// Caches report their size when a report is made instead of on every change. Caches with the
+// same name, e.g. the buffers of all documents, are summed up. Main thread only.
+using SizeFunction = std::function<qint64()>;
+void addCache(const void *owner, const QString &name, const SizeFunction &size);
+void removeCache(const void *owner);
+
+// One line per cache name and one for the process.
+QString report();
+
+} // namespace ClangFormat::Memory
@@ -0,0 +1,509 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatnativeindenter.h"
+
+#include "clangformatbaseindenter.h"
+
+#include <utils/async.h>
+
+#include <QTextDocument>
+
+#include <algorithm>
+
+namespace ClangFormat {
+
+namespace {
+
+int agreements = 0;
+int disagreements = 0;
+
+const int verificationDelayMs = 500;
+
+bool isIdentifierChar(QChar ch)
+{
+    return ch.isLetterOrNumber() || ch == '_';
+}
+
+bool startsWithWord(QStringView text, QStringView word)
+{
+    return text.startsWith(word)
+           && (text.size() == word.size() || !isIdentifierChar(text.at(word.size())));
+}
+
+bool isAccessSpecifier(QStringView text)
+{
+    static const QStringView specifiers[] = {u"public", u"protected", u"private", u"signals",
+                                             u"slots", u"Q_SIGNALS", u"Q_SLOTS"};
+    for (QStringView specifier : specifiers) {
+        if (!startsWithWord(text, specifier))
+            continue;
+        // "public slots:", "private Q_SLOTS:", "signals:", ...
+        const QStringView rest = text.mid(specifier.size()).trimmed();
+        return rest.startsWith(':') || startsWithWord(rest, u"slots")
+               || startsWithWord(rest, u"Q_SLOTS");
+    }
+    return false;
+}
+
+bool isControlKeyword(const std::string &keyword)
+{
+    return keyword == "if" || keyword == "for" || keyword == "while" || keyword == "else"
+           || keyword == "do";
+}
+
+int firstNonSpace(QStringView text)
+{
+    for (int i = 0; i < text.size(); ++i) {
+        if (!text.at(i).isSpace())
+            return i;
+    }
+    return -1;
+}
+
+int columnAt(QStringView text, int position, int tabWidth)
+{
+    int column = 0;
+    for (int i = 0; i < position && i < text.size(); ++i) {
+        if (text.at(i) == '\t')
+            column = (column / tabWidth + 1) * tabWidth;
+        else
+            ++column;
+    }
+    return column;
+}
+
+bool alignAfterOpenBracket(const clang::format::FormatStyle &style)
+{
+#if LLVM_VERSION_MAJOR >= 22
+    return style.AlignAfterOpenBracket;
+#else
+    return style.AlignAfterOpenBracket == clang::format::FormatStyle::BAS_Align;
+#endif
+}
+
+} // namespace
+
+bool NativeIndentationEngine::Settings::operator==(const Settings &other) const
+{
+    return indentWidth == other.indentWidth
+           && continuationIndentWidth == other.continuationIndentWidth
+           && accessModifierOffset == other.accessModifierOffset
+           && constructorInitializerIndentWidth == other.constructorInitializerIndentWidth
+           && tabWidth == other.tabWidth && namespaceIndentation == other.namespaceIndentation
+           && useTab == other.useTab && indentCaseLabels == other.indentCaseLabels
+           && alignAfterOpenBracket == other.alignAfterOpenBracket
+           && statementMacros == other.statementMacros;
+}
+
+NativeIndentationEngine::NativeIndentationEngine(QTextDocument *doc)
+    : m_doc(doc)
+{
+    // Everything from the changed block on has to be scanned again.
+    connect(doc, &QTextDocument::contentsChange, this, [this](int position, int, int) {
+        const int changedBlock = std::max(0, m_doc->findBlock(position).blockNumber());
+        if (changedBlock < int(m_states.size()))
+            m_states.resize(changedBlock);
+    });
+
+    m_verificationTimer.setSingleShot(true);
+    m_verificationTimer.setInterval(verificationDelayMs);
+    connect(&m_verificationTimer, &QTimer::timeout, this, &NativeIndentationEngine::verify);
+}
+
+NativeIndentationEngine::~NativeIndentationEngine() = default;
+
+void NativeIndentationEngine::setStyle(const clang::format::FormatStyle &style)
+{
+    Settings settings;
+    settings.indentWidth = int(style.IndentWidth);
+    settings.continuationIndentWidth = int(style.ContinuationIndentWidth);
+    settings.accessModifierOffset = style.AccessModifierOffset;
+    settings.constructorInitializerIndentWidth = int(style.ConstructorInitializerIndentWidth);
+    settings.tabWidth = std::max(1, int(style.TabWidth));
+    settings.namespaceIndentation = style.NamespaceIndentation;
+    settings.useTab = style.UseTab;
+    settings.indentCaseLabels = style.IndentCaseLabels;
+    settings.alignAfterOpenBracket = alignAfterOpenBracket(style);
+    settings.statementMacros = style.StatementMacros;
+
+    if (settings == m_settings)
+        return;
+    m_settings = settings;
+    m_states.clear();
+}
+
+int NativeIndentationEngine::indentFor(const QTextBlock &block)
+{
+    if (!block.isValid() || block.document() != m_doc)
+        return -1;
+
+    const QTextBlock previous = block.previous();
+    const QString text = block.text();
+    if (!previous.isValid())
+        return lineIndentation(BlockState(), text);
+    return lineIndentation(stateAfter(previous), text);
+}
+
+QString NativeIndentationEngine::indentationString(int column) const
+{
+    if (m_settings.useTab == clang::format::FormatStyle::UT_Never)
+        return QString(column, ' ');
+    return QString(column / m_settings.tabWidth, '\t')
+           + QString(column % m_settings.tabWidth, ' ');
+}
+
+void NativeIndentationEngine::scheduleVerification(const QTextBlock &block,
+                                                   int nativeIndentation,
+                                                   const ReferenceIndentation &reference)
+{
+    m_verificationBlockNumber = block.blockNumber();
+    m_verificationRevision = m_doc->revision();
+    m_verificationIndentation = nativeIndentation;
+    m_reference = reference;
+    m_verificationTimer.start();
+}
+
+std::size_t NativeIndentationEngine::memoryBytes() const
+{
+    std::size_t bytes = m_states.capacity() * sizeof(BlockState);
+    for (const BlockState &state : m_states)
+        bytes += state.scopes.capacity() * sizeof(Scope) + state.statementKeyword.capacity();
+    return bytes;
+}
+
+int NativeIndentationEngine::agreementCount()
+{
+    return agreements;
+}
+
+int NativeIndentationEngine::disagreementCount()
+{
+    return disagreements;
+}
+
+void NativeIndentationEngine::verify()
+{
+    // Only compare against the document the native result was computed for.
+    if (!m_reference || m_doc->revision() != m_verificationRevision)
+        return;
+
+    const QTextBlock block = m_doc->findBlockByNumber(m_verificationBlockNumber);
+    const int native = int(indentationString(m_verificationIndentation).size());
+    const int lineNumber = m_verificationBlockNumber + 1;
+    const QString text = block.text();
+    Utils::onResultReady(m_reference(block), this, [native, lineNumber, text](int reference) {
+        if (reference < 0)
+            return;
+        if (native == reference) {
+            ++agreements;
+            return;
+        }
+
+        ++disagreements;
+        qCDebug(clangIndenterLog).noquote()
+            << QString("Native indentation %1 differs from clang-format %2 in line %3: \"%4\" "
+                       "(%5 of %6 checked lines differ)")
+                   .arg(native)
+                   .arg(reference)
+                   .arg(lineNumber)
+                   .arg(text)
+                   .arg(disagreements)
+                   .arg(agreements + disagreements);
+    });
+}
+
+const NativeIndentationEngine::BlockState &NativeIndentationEngine::stateAfter(
+    const QTextBlock &block)
+{
+    const int blockNumber = block.blockNumber();
+    if (int(m_states.size()) <= blockNumber) {
+        m_states.reserve(blockNumber + 1);
+        QTextBlock current = m_doc->findBlockByNumber(int(m_states.size()));
+        while (int(m_states.size()) <= blockNumber && current.isValid()) {
+            const BlockState before = m_states.empty() ? BlockState() : m_states.back();
+            m_states.push_back(scanBlock(before, current));
+            current = current.next();
+        }
+    }
+    return m_states.at(blockNumber);
+}
+
+NativeIndentationEngine::Scope NativeIndentationEngine::openScope(const BlockState &state,
+                                                                  int lineIndentation,
+                                                                  int column) const
+{
+    const Scope *top = state.scopes.empty() ? nullptr : &state.scopes.back();
+    const int opener = state.statementKeyword.empty() ? lineIndentation : state.statementIndentation;
+    const QChar last = state.lastSignificantChar;
+
+    if ((top && (top->kind == ScopeKind::Paren || top->kind == ScopeKind::BracedList))
+        || last == '=' || last == ',' || last == '(' || state.statementKeyword == "return") {
+        const int content = column >= 0 && m_settings.alignAfterOpenBracket
+                                ? column
+                                : lineIndentation + m_settings.continuationIndentWidth;
+        return {ScopeKind::BracedList, lineIndentation, content};
+    }
+
+    const std::string &keyword = state.statementKeyword;
+    if (keyword == "namespace") {
+        using NI = clang::format::FormatStyle::NamespaceIndentationKind;
+        const bool nested = std::any_of(state.scopes.begin(), state.scopes.end(),
+                                        [](const Scope &scope) {
+                                            return scope.kind == ScopeKind::Namespace;
+                                        });
+        const bool indent = m_settings.namespaceIndentation == NI::NI_All
+                            || (m_settings.namespaceIndentation == NI::NI_Inner && nested);
+        return {ScopeKind::Namespace, opener, opener + (indent ? m_settings.indentWidth : 0)};
+    }
+    if (keyword == "extern")
+        return {ScopeKind::ExternBlock, opener, opener};
+    if (keyword == "class" || keyword == "struct" || keyword == "union")
+        return {ScopeKind::Class, opener, opener + m_settings.indentWidth};
+    if (keyword == "enum")
+        return {ScopeKind::Enum, opener, opener + m_settings.indentWidth};
+    if (keyword == "switch") {
+        return {ScopeKind::Switch,
+                opener,
+                opener + m_settings.indentWidth
+                    + (m_settings.indentCaseLabels ? m_settings.indentWidth : 0)};
+    }
+    return {ScopeKind::Block, opener, opener + m_settings.indentWidth};
+}
+
+NativeIndentationEngine::BlockState NativeIndentationEngine::scanBlock(const BlockState &before,
+                                                                       const QTextBlock &block) const
+{
+    BlockState state = before;
+    const QString blockText = block.text();
+    const QStringView text(blockText);
+    const int first = firstNonSpace(text);
+    if (first < 0)
+        return state;
+    if (!state.inBlockComment && text.at(first) == '#')
+        return state; // Preprocessor lines do not take part in statements.
+
+    const int lineIndentation = columnAt(text, first, m_settings.tabWidth);
+    QStringView lastWord;
+    int wordCount = 0;
+
+    const auto startStatementIfNeeded = [&](const std::string &keyword) {
+        if (!state.statementKeyword.empty())
+            return;
+        state.statementKeyword = keyword;
+        state.statementIndentation = lineIndentation;
+    };
+    const auto endStatement = [&] {
+        state.statementKeyword.clear();
+        state.statementContinues = false;
+        state.controlStatementBody = false;
+        state.constructorInitializer = false;
+        wordCount = 0;
+    };
+    const auto contentColumnAfter = [&](int position) {
+        for (int i = position + 1; i < text.size(); ++i) {
+            if (text.at(i).isSpace())
+                continue;
+            if (text.mid(i).startsWith(u"//") || text.mid(i).startsWith(u"/*"))
+                return -1;
+            return columnAt(text, i, m_settings.tabWidth);
+        }
+        return -1;
+    };
+
+    for (int i = first; i < text.size(); ++i) {
+        const QChar ch = text.at(i);
+        const QChar next = i + 1 < text.size() ? text.at(i + 1) : QChar();
+
+        if (state.inBlockComment) {
+            if (ch == '*' && next == '/') {
+                state.inBlockComment = false;
+                ++i;
+            }
+            continue;
+        }
+        if (ch.isSpace())
+            continue;
+        if (ch == '/' && next == '/')
+            break;
+        if (ch == '/' && next == '*') {
+            state.inBlockComment = true;
+            ++i;
+            continue;
+        }
+
+        if (ch == '"' || ch == '\'') {
+            startStatementIfNeeded("\"");
+            for (++i; i < text.size() && text.at(i) != ch; ++i) {
+                if (text.at(i) == '\\')
+                    ++i;
+            }
+            state.lastSignificantChar = ch;
+            continue;
+        }
+
+        if (isIdentifierChar(ch)) {
+            int end = i;
+            while (end < text.size() && isIdentifierChar(text.at(end)))
+                ++end;
+            lastWord = text.mid(i, end - i);
+            ++wordCount;
+            const std::string word = lastWord.toString().toStdString();
+            const bool atStatementLevel = state.scopes.empty()
+                                          || state.scopes.back().kind != ScopeKind::Paren;
+            if (state.statementKeyword.empty()) {
+                startStatementIfNeeded(word);
+            } else if (atStatementLevel && state.statementKeyword != "enum"
+                       && (word == "class" || word == "struct" || word == "union"
+                           || word == "enum" || word == "namespace")) {
+                // "template<...> class", "typedef struct", "inline namespace", ...
+                state.statementKeyword = word;
+            }
+            state.lastSignificantChar = 'a';
+            i = end - 1;
+            continue;
+        }
+
+        switch (ch.toLatin1()) {
+        case '{':
+            state.scopes.push_back(openScope(state, lineIndentation, contentColumnAfter(i)));
+            if (state.scopes.back().kind != ScopeKind::BracedList)
+                endStatement();
+            state.lastSignificantChar = ch;
+            break;
+        case '(':
+        case '[': {
+            startStatementIfNeeded("(");
+            const int column = contentColumnAfter(i);
+            const int content = column >= 0 && m_settings.alignAfterOpenBracket
+                                    ? column
+                                    : lineIndentation + m_settings.continuationIndentWidth;
+            state.scopes.push_back({ScopeKind::Paren, lineIndentation, content});
+            state.lastSignificantChar = ch;
+            break;
+        }
+        case ')':
+        case ']':
+            if (!state.scopes.empty() && state.scopes.back().kind == ScopeKind::Paren)
+                state.scopes.pop_back();
+            state.lastSignificantChar = ')';
+            break;
+        case '}': {
+            const bool bracedList = !state.scopes.empty()
+                                    && state.scopes.back().kind == ScopeKind::BracedList;
+            if (!state.scopes.empty())
+                state.scopes.pop_back();
+            if (!bracedList)
+                endStatement();
+            state.lastSignificantChar = ch;
+            break;
+        }
+        case ';':
+            if (state.scopes.empty() || state.scopes.back().kind != ScopeKind::Paren) {
+                endStatement();
+            }
+            state.lastSignificantChar = ch;
+            break;
+        case ',':
+            if (!state.scopes.empty() && state.scopes.back().kind == ScopeKind::Enum)
+                endStatement();
+            state.lastSignificantChar = ch;
+            break;
+        case ':':
+            if (next == ':') {
+                ++i;
+                state.lastSignificantChar = 'a';
+                break;
+            }
+            if (state.statementKeyword == "case" || state.statementKeyword == "default"
+                || isAccessSpecifier(text.mid(first))) {
+                endStatement();
+            } else if (state.lastSignificantChar == ')'
+                       && (state.scopes.empty() || state.scopes.back().kind == ScopeKind::Class
+                           || state.scopes.back().kind == ScopeKind::Namespace)) {
+                state.constructorInitializer = true;
+            }
+            state.lastSignificantChar = ch;
+            break;
+        default:
+            startStatementIfNeeded(std::string(1, ch.toLatin1()));
+            state.lastSignificantChar = ch;
+            break;
+        }
+    }
+
+    if (state.statementKeyword.empty())
+        return state;
+
+    // Statement macros like Q_OBJECT end a statement without a semicolon.
+    if (wordCount == 1 && state.lastSignificantChar == 'a'
+        && std::find(m_settings.statementMacros.begin(), m_settings.statementMacros.end(),
+                     state.statementKeyword)
+               != m_settings.statementMacros.end()) {
+        endStatement();
+        return state;
+    }
+
+    if (isControlKeyword(state.statementKeyword)
+        && (state.lastSignificantChar == ')' || lastWord == u"else" || lastWord == u"do")) {
+        state.statementKeyword.clear();
+        state.statementContinues = false;
+        state.controlStatementBody = true;
+        return state;
+    }
+
+    // "template<typename T>" is followed by the declaration on the same indentation.
+    if (state.statementKeyword == "template" && state.lastSignificantChar == '>') {
+        state.statementContinues = false;
+        return state;
+    }
+
+    state.statementContinues = true;
+    return state;
+}
+
+int NativeIndentationEngine::lineIndentation(const BlockState &before, QStringView text) const
+{
+    if (before.inBlockComment)
+        return -1;
+
+    const int first = firstNonSpace(text);
+    const QStringView line = first < 0 ? QStringView() : text.mid(first);
+    if (line.startsWith('#'))
+        return 0;
+
+    const Scope *top = before.scopes.empty() ? nullptr : &before.scopes.back();
+    if (top && (line.startsWith('}') || line.startsWith(')') || line.startsWith(']')))
+        return top->openerIndentation;
+
+    const int base = top ? top->contentIndentation : 0;
+    if (top && (top->kind == ScopeKind::Paren || top->kind == ScopeKind::BracedList))
+        return base;
+
+    if (top && top->kind == ScopeKind::Switch
+        && (startsWithWord(line, u"case") || startsWithWord(line, u"default"))) {
+        return top->openerIndentation
+               + (m_settings.indentCaseLabels ? m_settings.indentWidth : 0);
+    }
+
+    if (top && top->kind == ScopeKind::Class && isAccessSpecifier(line))
+        return std::max(0, base + m_settings.accessModifierOffset);
+
+    if (line.startsWith('{'))
+        return before.statementKeyword.empty() ? base : before.statementIndentation;
+
+    if (before.constructorInitializer
+        || (before.lastSignificantChar == ')' && line.startsWith(':') && !line.startsWith(u"::"))) {
+        return before.statementIndentation + m_settings.constructorInitializerIndentWidth;
+    }
+
+    if (before.controlStatementBody)
+        return base + m_settings.indentWidth;
+
+    if (before.statementContinues)
+        return before.statementIndentation + m_settings.continuationIndentWidth;
+
+    return base;
+}
+
+} // namespace ClangFormat
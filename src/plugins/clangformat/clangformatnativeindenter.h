@@ -0,0 +1,110 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <clang/Format/Format.h>
+
+#include <QFuture>
+#include <QObject>
+#include <QTextBlock>
+#include <QTimer>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+class QTextDocument;
+QT_END_NAMESPACE
+
+namespace ClangFormat {
+
+// Computes the indentation of single lines from the indentation related options of a
+// FormatStyle, without running clang::format::reformat(). The brace and statement state at
+// the end of each block is cached and only recomputed from the first changed block on.
+//
+// Only meant for the Enter and electric character paths. indentFor() returns -1 for lines it
+// cannot judge (inside block comments, for example), the caller falls back to clang-format.
+class NativeIndentationEngine final : public QObject
+{
+public:
+    explicit NativeIndentationEngine(QTextDocument *doc);
+    ~NativeIndentationEngine() final;
+
+    void setStyle(const clang::format::FormatStyle &style);
+
+    int indentFor(const QTextBlock &block);
+    QString indentationString(int column) const;
+
+    // Compares the native result with the one of clang-format once the editor is idle and
+    // the document did not change in between. Only the latest request is checked. The
+    // reference runs in the background and yields -1 if clang-format cannot judge the line.
+    using ReferenceIndentation = std::function<QFuture<int>(const QTextBlock &block)>;
+    void scheduleVerification(const QTextBlock &block,
+                              int nativeIndentation,
+                              const ReferenceIndentation &reference);
+
+    // The cached block states, for the memory budget of the open documents.
+    std::size_t memoryBytes() const;
+
+    static int agreementCount();
+    static int disagreementCount();
+
+    enum class ScopeKind : char { Namespace, ExternBlock, Class, Enum, Switch, Block, BracedList, Paren };
+
+    struct Scope
+    {
+        ScopeKind kind;
+        int openerIndentation;  // indentation of the line that opened the scope
+        int contentIndentation; // indentation of the lines inside the scope
+    };
+
+    struct BlockState
+    {
+        std::vector<Scope> scopes;
+        std::string statementKeyword; // first identifier of the current statement
+        int statementIndentation = 0;
+        QChar lastSignificantChar;
+        bool inBlockComment = false;
+        bool statementContinues = false;
+        bool controlStatementBody = false; // after "if (...)", "else", ... without a brace
+        bool constructorInitializer = false;
+    };
+
+private:
+    struct Settings
+    {
+        int indentWidth = 4;
+        int continuationIndentWidth = 4;
+        int accessModifierOffset = -4;
+        int constructorInitializerIndentWidth = 4;
+        int tabWidth = 4;
+        clang::format::FormatStyle::NamespaceIndentationKind namespaceIndentation
+            = clang::format::FormatStyle::NI_None;
+        clang::format::FormatStyle::UseTabStyle useTab = clang::format::FormatStyle::UT_Never;
+        bool indentCaseLabels = false;
+        bool alignAfterOpenBracket = true;
+        std::vector<std::string> statementMacros;
+
+        bool operator==(const Settings &other) const;
+    };
+
+    const BlockState &stateAfter(const QTextBlock &block);
+    BlockState scanBlock(const BlockState &before, const QTextBlock &block) const;
+    int lineIndentation(const BlockState &before, QStringView text) const;
+    Scope openScope(const BlockState &state, int lineIndentation, int column) const;
+    void verify();
+
+    QTextDocument *m_doc = nullptr;
+    Settings m_settings;
+    std::vector<BlockState> m_states; // valid prefix, indexed by block number
+
+    QTimer m_verificationTimer;
+    int m_verificationBlockNumber = -1;
+    int m_verificationRevision = -1;
+    int m_verificationIndentation = -1;
+    ReferenceIndentation m_reference;
+};
+
+} // namespace ClangFormat
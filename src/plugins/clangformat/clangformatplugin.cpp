@@ -1,21 +1,32 @@
 // Copyright (C) 2016 The Qt Company Ltd.
 // SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
 
+#include "clangformatbenchmark.h"
 #include "clangformatconstants.h"
 #include "clangformatglobalconfigwidget.h"
+#include "clangformatmemory.h"
+#include "clangformatstatisticsview.h"
 #include "clangformattr.h"
+#include "clangformatutils.h"
 #include "tests/clangformat-test.h"
 
 #include <coreplugin/actionmanager/actioncontainer.h>
 #include <coreplugin/actionmanager/actionmanager.h>
+#include <coreplugin/coreconstants.h>
 #include <coreplugin/editormanager/editormanager.h>
 #include <coreplugin/editormanager/ieditor.h>
+#include <coreplugin/icore.h>
 #include <coreplugin/idocument.h>
 
 #include <cppeditor/cppeditorconstants.h>
 
 #include <extensionsystem/iplugin.h>
 
+#include <texteditor/icodestylepreferences.h>
+#include <texteditor/texteditorsettings.h>
+
+#include <QMessageBox>
+
 using namespace Core;
 using namespace Utils;
 
@@ -34,6 +45,10 @@ class ClangFormatPlugin final : public ExtensionSystem::IPlugin
 
     void initialize() final
     {
+        Benchmark::pluginInitializeStarted();
+
+        // Only swaps the factory pointer. Settings, styles and configuration files are
+        // resolved on first use by a C++ document or by the settings pages.
         setupClangFormatStyleFactory(this); // This overrides the default, see implementation.
 
         ActionContainer *contextMenu = ActionManager::actionContainer(CppEditor::Constants::M_CONTEXT);
@@ -52,9 +67,41 @@ class ClangFormatPlugin final : public ExtensionSystem::IPlugin
             });
         }
 
+        // Indenters keep the styles they resolved until something they come from changes.
+        connect(EditorManager::instance(), &EditorManager::saved, this, [](IDocument *document) {
+            const QString fileName = document->filePath().fileName();
+            if (fileName == QLatin1String(Constants::SETTINGS_FILE_NAME)
+                || fileName == QLatin1String(Constants::SETTINGS_FILE_ALT_NAME)) {
+                invalidateStyles();
+            }
+        });
+        if (TextEditor::ICodeStylePreferences *codeStyle
+            = TextEditor::TextEditorSettings::codeStyle(CppEditor::Constants::CPP_SETTINGS_ID)) {
+            connect(codeStyle,
+                    &TextEditor::ICodeStylePreferences::currentPreferencesChanged,
+                    this,
+                    &invalidateStyles);
+        }
+
+        ActionBuilder showMemory(this, Constants::SHOW_MEMORY_USAGE_ID);
+        showMemory.setText(Tr::tr("Show ClangFormat Memory Usage..."));
+        showMemory.addToContainer(Core::Constants::M_TOOLS_DEBUG);
+        showMemory.addOnTriggered(this, [] {
+            QMessageBox::information(ICore::dialogParent(),
+                                     Tr::tr("ClangFormat Memory Usage"),
+                                     Memory::report());
+        });
+
+        ActionBuilder showStatistics(this, Constants::SHOW_STATISTICS_ID);
+        showStatistics.setText(Tr::tr("Show ClangFormat Latency Statistics..."));
+        showStatistics.addToContainer(Core::Constants::M_TOOLS_DEBUG);
+        showStatistics.addOnTriggered(this, &showStatisticsView);
+
 #ifdef WITH_TESTS
         addTestCreator(Internal::createClangFormatTest);
 #endif
+
+        Benchmark::pluginInitializeFinished();
     }
 };
 
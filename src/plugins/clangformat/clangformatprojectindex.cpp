@@ -0,0 +1,197 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatprojectindex.h"
+
+#include "clangformatmemory.h"
+
+#include <projectexplorer/project.h>
+#include <projectexplorer/session.h>
+
+#include <utils/qtcassert.h>
+
+#include <QHash>
+#include <QObject>
+
+#include <memory>
+#include <unordered_map>
+
+using namespace ProjectExplorer;
+using namespace Utils;
+
+namespace ClangFormat {
+
+namespace {
+
+// A trie over the path components. Project directories and project files are entries at the
+// node of their last component, so a lookup costs one hash lookup per component of the path.
+class ProjectIndex : public QObject
+{
+public:
+    ProjectIndex();
+
+    Project *projectForFile(const FilePath &filePath) const;
+
+private:
+    struct Node
+    {
+        std::unordered_map<QString, std::unique_ptr<Node>> children;
+        QList<Project *> fileOwners;
+        QList<Project *> directoryOwners;
+    };
+
+    struct Entries
+    {
+        FilePath directory;
+        FilePaths files;
+    };
+
+    void addProject(Project *project);
+    void removeProject(Project *project);
+    void removeEntries(Project *project);
+
+    void insert(const FilePath &path, Project *project, bool isDirectory);
+    void erase(const FilePath &path, Project *project, bool isDirectory);
+
+    static QStringList components(const FilePath &path);
+    static qint64 bytes(const Node &node);
+
+    Node m_root;
+    QHash<Project *, Entries> m_entries;
+};
+
+ProjectIndex::ProjectIndex()
+{
+    SessionManager *sessionManager = SessionManager::instance();
+    connect(sessionManager, &SessionManager::projectAdded, this, &ProjectIndex::addProject);
+    connect(sessionManager, &SessionManager::projectRemoved, this, &ProjectIndex::removeProject);
+    for (Project *project : SessionManager::projects())
+        addProject(project);
+    Memory::addCache(this, "Project file index", [this] { return bytes(m_root); });
+}
+
+qint64 ProjectIndex::bytes(const Node &node)
+{
+    qint64 result = sizeof(Node) + (node.fileOwners.size() + node.directoryOwners.size())
+                                       * sizeof(Project *);
+    for (const auto &[component, child] : node.children)
+        result += component.capacity() * sizeof(QChar) + bytes(*child);
+    return result;
+}
+
+QStringList ProjectIndex::components(const FilePath &path)
+{
+    // The device comes first, so that equal paths on different devices do not meet.
+    QStringList result{path.scheme() + "://" + path.host()};
+    const QString pathString = path.caseSensitivity() == Qt::CaseInsensitive
+                                   ? path.path().toLower()
+                                   : path.path();
+    for (const QString &component : pathString.split('/', Qt::SkipEmptyParts))
+        result.append(component);
+    return result;
+}
+
+void ProjectIndex::addProject(Project *project)
+{
+    if (m_entries.contains(project)) {
+        removeEntries(project);
+    } else {
+        connect(project, &Project::fileListChanged, this, [this, project] {
+            addProject(project);
+        });
+    }
+
+    Entries entries{project->projectDirectory(), project->files(Project::AllFiles)};
+    insert(entries.directory, project, true);
+    for (const FilePath &file : std::as_const(entries.files))
+        insert(file, project, false);
+    m_entries.insert(project, std::move(entries));
+}
+
+void ProjectIndex::removeProject(Project *project)
+{
+    removeEntries(project);
+    m_entries.remove(project);
+    disconnect(project, nullptr, this, nullptr);
+}
+
+void ProjectIndex::removeEntries(Project *project)
+{
+    const auto it = m_entries.constFind(project);
+    if (it == m_entries.constEnd())
+        return;
+    erase(it->directory, project, true);
+    for (const FilePath &file : it->files)
+        erase(file, project, false);
+}
+
+void ProjectIndex::insert(const FilePath &path, Project *project, bool isDirectory)
+{
+    if (path.isEmpty())
+        return;
+    Node *node = &m_root;
+    for (const QString &component : components(path)) {
+        std::unique_ptr<Node> &child = node->children[component];
+        if (!child)
+            child = std::make_unique<Node>();
+        node = child.get();
+    }
+    QList<Project *> &owners = isDirectory ? node->directoryOwners : node->fileOwners;
+    if (!owners.contains(project))
+        owners.append(project);
+}
+
+void ProjectIndex::erase(const FilePath &path, Project *project, bool isDirectory)
+{
+    if (path.isEmpty())
+        return;
+    const QStringList pathComponents = components(path);
+    QList<Node *> nodes{&m_root};
+    for (const QString &component : pathComponents) {
+        const auto child = nodes.last()->children.find(component);
+        QTC_ASSERT(child != nodes.last()->children.end(), return);
+        nodes.append(child->second.get());
+    }
+    (isDirectory ? nodes.last()->directoryOwners : nodes.last()->fileOwners).removeOne(project);
+
+    // Drop the nodes that lead nowhere anymore, so that renamed files do not accumulate.
+    for (int i = pathComponents.size(); i > 0; --i) {
+        const Node *node = nodes.at(i);
+        if (!node->children.empty() || !node->fileOwners.isEmpty()
+            || !node->directoryOwners.isEmpty()) {
+            break;
+        }
+        nodes.at(i - 1)->children.erase(pathComponents.at(i - 1));
+    }
+}
+
+Project *ProjectIndex::projectForFile(const FilePath &filePath) const
+{
+    if (filePath.isEmpty())
+        return nullptr;
+
+    Project *deepestDirectoryOwner = nullptr;
+    const Node *node = &m_root;
+    for (const QString &component : components(filePath)) {
+        if (!node->directoryOwners.isEmpty())
+            deepestDirectoryOwner = node->directoryOwners.first();
+        const auto child = node->children.find(component);
+        if (child == node->children.end())
+            return deepestDirectoryOwner;
+        node = child->second.get();
+    }
+    if (!node->fileOwners.isEmpty())
+        return node->fileOwners.first();
+    return node->directoryOwners.isEmpty() ? deepestDirectoryOwner
+                                           : node->directoryOwners.first();
+}
+
+} // namespace
+
+Project *projectForFile(const FilePath &filePath)
+{
+    static ProjectIndex index;
+    return index.projectForFile(filePath);
+}
+
+} // namespace ClangFormat
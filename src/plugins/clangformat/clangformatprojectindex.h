@@ -0,0 +1,18 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/filepath.h>
+
+namespace ProjectExplorer { class Project; }
+
+namespace ClangFormat {
+
+// Like SessionManager::projectForFile(), without scanning the file lists of all open projects
+// for every request: a project that lists the file wins, otherwise the project with the
+// deepest project directory containing it. The index is built on first use and follows
+// projects being added, removed and changing their file lists.
+ProjectExplorer::Project *projectForFile(const Utils::FilePath &filePath);
+
+} // namespace ClangFormat
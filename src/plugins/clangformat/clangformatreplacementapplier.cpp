@@ -0,0 +1,200 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatreplacementapplier.h"
+
+#include "clangformatconstants.h"
+
+#include <coreplugin/editormanager/documentmodel.h>
+#include <coreplugin/progressmanager/progressmanager.h>
+
+#include <texteditor/textdocument.h>
+#include <texteditor/texteditor.h>
+
+#include <QElapsedTimer>
+#include <QFutureInterface>
+#include <QHash>
+#include <QPointer>
+#include <QTextCursor>
+#include <QTimer>
+
+using namespace TextEditor;
+using namespace Utils;
+
+namespace ClangFormat {
+
+namespace {
+
+// Short enough for the editor to paint in between at 60 frames per second.
+const int sliceMs = 10;
+
+class SlicedApplication final : public QObject
+{
+public:
+    SlicedApplication(QTextDocument *doc, const Text::Replacements &replacements,
+                      const QString &title);
+    ~SlicedApplication() final;
+
+    void applySlice(bool all);
+
+private:
+    void lockEditors(QTextDocument *doc);
+    void rebase(int position, int charsRemoved, int charsAdded);
+    void done();
+
+    QTextDocument *m_doc = nullptr;
+    QTextCursor m_cursor;
+    Text::Replacements m_replacements;
+    std::size_t m_next = 0;
+    // The replacements refer to the document before the first one was applied.
+    int m_offsetShift = 0;
+    bool m_applying = false;
+    QFutureInterface<void> m_progress;
+    QList<QPointer<TextEditorWidget>> m_lockedEditors;
+};
+
+QHash<QTextDocument *, SlicedApplication *> &runningApplications()
+{
+    static QHash<QTextDocument *, SlicedApplication *> applications;
+    return applications;
+}
+
+SlicedApplication::SlicedApplication(QTextDocument *doc,
+                                     const Text::Replacements &replacements,
+                                     const QString &title)
+    : QObject(doc)
+    , m_doc(doc)
+    , m_cursor(doc)
+    , m_replacements(replacements)
+{
+    runningApplications().insert(doc, this);
+    lockEditors(doc);
+    connect(doc,
+            &QTextDocument::contentsChange,
+            this,
+            [this](int position, int charsRemoved, int charsAdded) {
+                if (m_applying)
+                    return;
+                // Somebody else edited the document. Whoever did it expects the document to be
+                // formatted completely afterwards, so the rest is applied now.
+                rebase(position, charsRemoved, charsAdded);
+                applySlice(true);
+            });
+
+    m_progress.setProgressRange(0, int(m_replacements.size()));
+    m_progress.reportStarted();
+    Core::ProgressManager::addTask(m_progress.future(),
+                                   title,
+                                   Constants::APPLY_REPLACEMENTS_TASK_ID);
+
+    QTimer::singleShot(0, this, [this] { applySlice(false); });
+}
+
+SlicedApplication::~SlicedApplication()
+{
+    // Also reached when the document is closed in between.
+    done();
+}
+
+void SlicedApplication::lockEditors(QTextDocument *doc)
+{
+    for (Core::IDocument *document : Core::DocumentModel::openedDocuments()) {
+        const auto textDocument = qobject_cast<TextDocument *>(document);
+        if (!textDocument || textDocument->document() != doc)
+            continue;
+        for (Core::IEditor *editor : Core::DocumentModel::editorsForDocument(document)) {
+            TextEditorWidget *widget = TextEditorWidget::fromEditor(editor);
+            if (widget && !widget->isReadOnly()) {
+                widget->setReadOnly(true);
+                m_lockedEditors.append(widget);
+            }
+        }
+    }
+}
+
+// Moves the remaining replacements to the positions in the edited document and restarts
+// with them, so that they form an undo step of their own. The edit wins over the replacements
+// that overlap it.
+void SlicedApplication::rebase(int position, int charsRemoved, int charsAdded)
+{
+    Text::Replacements remaining;
+    remaining.reserve(m_replacements.size() - m_next);
+    for (std::size_t index = m_next; index < m_replacements.size(); ++index) {
+        Text::Replacement replacement = m_replacements[index];
+        replacement.offset += m_offsetShift;
+        if (replacement.offset >= position + charsRemoved)
+            replacement.offset += charsAdded - charsRemoved;
+        else if (replacement.offset + replacement.length > position)
+            continue;
+        remaining.push_back(replacement);
+    }
+    m_replacements = std::move(remaining);
+    m_next = 0;
+    m_offsetShift = 0;
+    m_progress.setProgressRange(0, int(m_replacements.size()));
+}
+
+void SlicedApplication::done()
+{
+    if (runningApplications().value(m_doc) != this)
+        return;
+    runningApplications().remove(m_doc);
+    for (const QPointer<TextEditorWidget> &widget : std::as_const(m_lockedEditors)) {
+        if (widget)
+            widget->setReadOnly(false);
+    }
+    m_lockedEditors.clear();
+    m_progress.reportFinished();
+}
+
+void SlicedApplication::applySlice(bool all)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Joining the previous edit block keeps all slices in one undo step. The editors are
+    // read-only, and an edit by somebody else in between restarts with a new edit block.
+    if (m_next == 0)
+        m_cursor.beginEditBlock();
+    else
+        m_cursor.joinPreviousEditBlock();
+    m_applying = true;
+    while (m_next < m_replacements.size() && !m_progress.isCanceled()
+           && (all || timer.elapsed() < sliceMs)) {
+        const Text::Replacement &replacement = m_replacements[m_next++];
+        m_cursor.setPosition(replacement.offset + m_offsetShift);
+        m_cursor.setPosition(replacement.offset + m_offsetShift + replacement.length,
+                             QTextCursor::KeepAnchor);
+        m_cursor.insertText(replacement.text);
+        m_offsetShift += int(replacement.text.size()) - replacement.length;
+    }
+    m_cursor.endEditBlock();
+    m_applying = false;
+    m_progress.setProgressValue(int(m_next));
+
+    if (m_next < m_replacements.size() && !m_progress.isCanceled()) {
+        if (!all)
+            QTimer::singleShot(0, this, [this] { applySlice(false); });
+        return;
+    }
+    done();
+    deleteLater();
+}
+
+} // namespace
+
+void applyReplacementsInSlices(QTextDocument *doc,
+                               const Text::Replacements &replacements,
+                               const QString &title)
+{
+    finishApplyingReplacements(doc);
+    new SlicedApplication(doc, replacements, title);
+}
+
+void finishApplyingReplacements(QTextDocument *doc)
+{
+    if (SlicedApplication *application = runningApplications().value(doc))
+        application->applySlice(true);
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,29 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/textutils.h>
+
+QT_BEGIN_NAMESPACE
+class QTextDocument;
+QT_END_NAMESPACE
+
+namespace ClangFormat {
+
+// Applies the replacements of a huge formatting result in slices of bounded duration from
+// the event loop, so that the editor keeps painting. The editors of the document are
+// read-only meanwhile, a progress indicator is shown, and all slices form a single undo step.
+// Canceling the progress keeps what was applied so far, undo reverts it. If somebody else
+// edits the document in between, the rest is applied right away in an undo step of its own,
+// without the replacements that overlap the edit, so that the document is never left half
+// formatted.
+void applyReplacementsInSlices(QTextDocument *doc,
+                               const Utils::Text::Replacements &replacements,
+                               const QString &title);
+
+// Applies what is left of a running application right away, e.g. before saving or
+// formatting the document again.
+void finishApplyingReplacements(QTextDocument *doc);
+
+} // namespace ClangFormat
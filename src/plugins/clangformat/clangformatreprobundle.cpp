@@ -0,0 +1,122 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatreprobundle.h"
+
+#include <utils/algorithm.h>
+
+#include <QDateTime>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+using namespace Utils;
+
+namespace ClangFormat {
+
+const char BUFFER_FILE_NAME[] = "buffer.cpp";
+const char STYLE_FILE_NAME[] = "style.clang-format";
+const char REQUEST_FILE_NAME[] = "request.json";
+
+expected_str<FilePath> writeReproBundle(const ReproBundle &bundle, const FilePath &directory)
+{
+    const QString name = QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz") + '-'
+                         + FilePath::fromString(bundle.fileName).fileName();
+    const FilePath bundleDirectory = directory / name;
+    if (!bundleDirectory.ensureWritableDir())
+        return make_unexpected(QString("Cannot create \"%1\".").arg(bundleDirectory.toUserOutput()));
+
+    QJsonArray ranges;
+    for (const clang::tooling::Range &range : bundle.ranges)
+        ranges.append(QJsonArray{int(range.getOffset()), int(range.getLength())});
+
+    const QJsonObject request{{"fileName", bundle.fileName},
+                              {"replacementsToKeep", bundle.replacementsToKeep},
+                              {"typedChar", bundle.typedChar},
+                              {"secondTry", bundle.secondTry},
+                              {"totalMs", bundle.totalMs},
+                              {"reformatMs", bundle.reformatMs},
+                              {"ranges", ranges}};
+
+    const std::pair<const char *, QByteArray> files[] = {
+        {BUFFER_FILE_NAME, bundle.buffer},
+        {STYLE_FILE_NAME, QByteArray::fromStdString(bundle.style)},
+        {REQUEST_FILE_NAME, QJsonDocument(request).toJson()}};
+    for (const auto &[fileName, contents] : files) {
+        const expected_str<qint64> result = (bundleDirectory / fileName).writeFileContents(contents);
+        if (!result)
+            return make_unexpected(result.error());
+    }
+
+    return bundleDirectory;
+}
+
+expected_str<ReproBundle> readReproBundle(const FilePath &bundleDirectory)
+{
+    const expected_str<QByteArray> buffer = (bundleDirectory / BUFFER_FILE_NAME).fileContents();
+    if (!buffer)
+        return make_unexpected(buffer.error());
+    const expected_str<QByteArray> style = (bundleDirectory / STYLE_FILE_NAME).fileContents();
+    if (!style)
+        return make_unexpected(style.error());
+    const expected_str<QByteArray> request = (bundleDirectory / REQUEST_FILE_NAME).fileContents();
+    if (!request)
+        return make_unexpected(request.error());
+
+    QJsonParseError error;
+    const QJsonObject object = QJsonDocument::fromJson(*request, &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        return make_unexpected(QString("Cannot parse \"%1\": %2")
+                                   .arg((bundleDirectory / REQUEST_FILE_NAME).toUserOutput(),
+                                        error.errorString()));
+    }
+
+    ReproBundle bundle;
+    bundle.buffer = *buffer;
+    bundle.style = style->toStdString();
+    bundle.fileName = object.value("fileName").toString();
+    bundle.replacementsToKeep = object.value("replacementsToKeep").toString();
+    bundle.typedChar = object.value("typedChar").toString();
+    bundle.secondTry = object.value("secondTry").toBool();
+    bundle.totalMs = object.value("totalMs").toInteger();
+    bundle.reformatMs = object.value("reformatMs").toInteger();
+    for (const QJsonValue &range : object.value("ranges").toArray()) {
+        const QJsonArray offsetAndLength = range.toArray();
+        bundle.ranges.emplace_back(static_cast<unsigned int>(offsetAndLength.at(0).toInt()),
+                                   static_cast<unsigned int>(offsetAndLength.at(1).toInt()));
+    }
+    return bundle;
+}
+
+void removeOldReproBundles(const FilePath &directory, int maxCount, qint64 maxBytes)
+{
+    FilePaths bundleDirectories = Utils::filtered(
+        directory.dirEntries(QDir::Dirs | QDir::NoDotAndDotDot),
+        [](const FilePath &bundleDirectory) {
+            return (bundleDirectory / REQUEST_FILE_NAME).exists();
+        });
+    // The names start with the time of the request.
+    std::sort(bundleDirectories.begin(),
+              bundleDirectories.end(),
+              [](const FilePath &first, const FilePath &second) {
+                  return first.fileName() > second.fileName();
+              });
+
+    qint64 keptBytes = 0;
+    bool keep = true;
+    for (int index = 0; index < int(bundleDirectories.size()); ++index) {
+        const FilePath &bundleDirectory = bundleDirectories.at(index);
+        if (keep) {
+            for (const char *fileName : {BUFFER_FILE_NAME, STYLE_FILE_NAME, REQUEST_FILE_NAME})
+                keptBytes += (bundleDirectory / fileName).fileSize();
+            keep = index == 0 || (index < maxCount && keptBytes <= maxBytes);
+        }
+        if (!keep)
+            bundleDirectory.removeRecursively();
+    }
+}
+
+} // namespace ClangFormat
@@ -0,0 +1,43 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/expected.h>
+#include <utils/filepath.h>
+
+#include <clang/Tooling/Core/Replacement.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <string>
+#include <vector>
+
+namespace ClangFormat {
+
+// Everything needed to replay a slow clang::format::reformat() call outside of the IDE.
+// Also used by the clangformatreplay tool, so keep it free of plugin dependencies.
+class ReproBundle
+{
+public:
+    QByteArray buffer; // UTF-8, exactly as passed to clang::format::reformat()
+    std::string style; // clang::format::configurationAsText() of the adjusted style
+    std::vector<clang::tooling::Range> ranges;
+    QString fileName;
+    QString replacementsToKeep;
+    QString typedChar;
+    bool secondTry = false;
+    qint64 totalMs = 0;
+    qint64 reformatMs = 0;
+};
+
+// Writes the bundle into a new sub-directory of \a directory and returns its path.
+Utils::expected_str<Utils::FilePath> writeReproBundle(const ReproBundle &bundle,
+                                                      const Utils::FilePath &directory);
+Utils::expected_str<ReproBundle> readReproBundle(const Utils::FilePath &bundleDirectory);
+// Removes the bundles in \a directory beyond the newest \a maxCount ones, and older ones once
+// they take more than \a maxBytes together. The newest bundle is always kept.
+void removeOldReproBundles(const Utils::FilePath &directory, int maxCount, qint64 maxBytes);
+
+} // namespace ClangFormat
@@ -3,6 +3,7 @@
 
 #include "clangformatconstants.h"
 #include "clangformatsettings.h"
+#include "clangformatutils.h"
 
 #include <coreplugin/icore.h>
 
@@ -25,13 +26,33 @@ ClangFormatSettings::ClangFormatSettings()
     m_useCustomSettings
         = settings->value(Constants::USE_CUSTOM_SETTINGS_ID, false).toBool();
     m_formatWhileTyping = settings->value(Constants::FORMAT_WHILE_TYPING_ID, false).toBool();
+    m_formatWhileTypingDelay = settings->value(Constants::FORMAT_WHILE_TYPING_DELAY_ID,
+                                               m_formatWhileTypingDelay).toInt();
     m_formatOnSave = settings->value(Constants::FORMAT_CODE_ON_SAVE_ID, false).toBool();
+    m_formatOnSaveRanges = static_cast<FormatOnSaveRanges>(
+        settings->value(Constants::FORMAT_ON_SAVE_RANGES_ID, m_formatOnSaveRanges).toInt());
+    m_applyFormattingInSlices = settings->value(Constants::APPLY_FORMATTING_IN_SLICES_ID,
+                                                m_applyFormattingInSlices).toBool();
     m_fileSizeThreshold = settings->value(Constants::FILE_SIZE_THREDSHOLD,
                                           m_fileSizeThreshold).toInt();
+    m_calibrateFileSizeThreshold = settings->value(Constants::CALIBRATE_FILE_SIZE_THRESHOLD_ID,
+                                                   false).toBool();
+    m_latencyTarget = settings->value(Constants::LATENCY_TARGET_ID, m_latencyTarget).toInt();
+    m_slowRequestThreshold = settings->value(Constants::SLOW_REQUEST_THRESHOLD_ID,
+                                             m_slowRequestThreshold).toInt();
+    m_documentStateBudget = settings->value(Constants::DOCUMENT_STATE_BUDGET_ID,
+                                            m_documentStateBudget).toInt();
+    m_indentationEngine = static_cast<IndentationEngine>(
+        settings->value(Constants::INDENTATION_ENGINE_ID, m_indentationEngine).toInt());
 
     // Convert old settings to new ones. New settings were added to QtC 8.0
-    bool isOldFormattingOn = settings->value(FORMAT_CODE_INSTEAD_OF_INDENT_ID, false).toBool();
-    Core::ICore::settings()->remove(FORMAT_CODE_INSTEAD_OF_INDENT_ID);
+    // Only touch the settings file if the old key is still there, removing a key marks the
+    // settings dirty and forces a write.
+    bool isOldFormattingOn = false;
+    if (settings->contains(FORMAT_CODE_INSTEAD_OF_INDENT_ID)) {
+        isOldFormattingOn = settings->value(FORMAT_CODE_INSTEAD_OF_INDENT_ID, false).toBool();
+        settings->remove(FORMAT_CODE_INSTEAD_OF_INDENT_ID);
+    }
 
     if (isOldFormattingOn) {
         settings->setValue(Constants::MODE_ID,
@@ -50,10 +71,19 @@ void ClangFormatSettings::write() const
     settings->beginGroup(Constants::SETTINGS_ID);
     settings->setValue(Constants::USE_CUSTOM_SETTINGS_ID, m_useCustomSettings);
     settings->setValue(Constants::FORMAT_WHILE_TYPING_ID, m_formatWhileTyping);
+    settings->setValue(Constants::FORMAT_WHILE_TYPING_DELAY_ID, m_formatWhileTypingDelay);
     settings->setValue(Constants::FORMAT_CODE_ON_SAVE_ID, m_formatOnSave);
+    settings->setValue(Constants::FORMAT_ON_SAVE_RANGES_ID, static_cast<int>(m_formatOnSaveRanges));
     settings->setValue(Constants::MODE_ID, static_cast<int>(m_mode));
+    settings->setValue(Constants::APPLY_FORMATTING_IN_SLICES_ID, m_applyFormattingInSlices);
     settings->setValue(Constants::FILE_SIZE_THREDSHOLD, m_fileSizeThreshold);
+    settings->setValue(Constants::CALIBRATE_FILE_SIZE_THRESHOLD_ID, m_calibrateFileSizeThreshold);
+    settings->setValue(Constants::LATENCY_TARGET_ID, m_latencyTarget);
+    settings->setValue(Constants::SLOW_REQUEST_THRESHOLD_ID, m_slowRequestThreshold);
+    settings->setValue(Constants::DOCUMENT_STATE_BUDGET_ID, m_documentStateBudget);
+    settings->setValue(Constants::INDENTATION_ENGINE_ID, static_cast<int>(m_indentationEngine));
     settings->endGroup();
+    invalidateStyles();
 }
 
 void ClangFormatSettings::setUseCustomSettings(bool enable)
@@ -76,6 +106,16 @@ bool ClangFormatSettings::formatWhileTyping() const
     return m_formatWhileTyping;
 }
 
+void ClangFormatSettings::setFormatWhileTypingDelay(int milliseconds)
+{
+    m_formatWhileTypingDelay = milliseconds;
+}
+
+int ClangFormatSettings::formatWhileTypingDelay() const
+{
+    return m_formatWhileTypingDelay;
+}
+
 void ClangFormatSettings::setFormatOnSave(bool enable)
 {
     m_formatOnSave = enable;
@@ -86,6 +126,16 @@ bool ClangFormatSettings::formatOnSave() const
     return m_formatOnSave;
 }
 
+void ClangFormatSettings::setFormatOnSaveRanges(FormatOnSaveRanges ranges)
+{
+    m_formatOnSaveRanges = ranges;
+}
+
+ClangFormatSettings::FormatOnSaveRanges ClangFormatSettings::formatOnSaveRanges() const
+{
+    return m_formatOnSaveRanges;
+}
+
 void ClangFormatSettings::setMode(Mode mode)
 {
     m_mode = mode;
@@ -96,6 +146,16 @@ ClangFormatSettings::Mode ClangFormatSettings::mode() const
     return m_mode;
 }
 
+void ClangFormatSettings::setApplyFormattingInSlices(bool enable)
+{
+    m_applyFormattingInSlices = enable;
+}
+
+bool ClangFormatSettings::applyFormattingInSlices() const
+{
+    return m_applyFormattingInSlices;
+}
+
 void ClangFormatSettings::setFileSizeThreshold(int fileSizeInKb)
 {
     m_fileSizeThreshold = fileSizeInKb;
@@ -106,4 +166,54 @@ int ClangFormatSettings::fileSizeThreshold() const
     return m_fileSizeThreshold;
 }
 
+void ClangFormatSettings::setCalibrateFileSizeThreshold(bool enable)
+{
+    m_calibrateFileSizeThreshold = enable;
+}
+
+bool ClangFormatSettings::calibrateFileSizeThreshold() const
+{
+    return m_calibrateFileSizeThreshold;
+}
+
+void ClangFormatSettings::setLatencyTarget(int milliseconds)
+{
+    m_latencyTarget = milliseconds;
+}
+
+int ClangFormatSettings::latencyTarget() const
+{
+    return m_latencyTarget;
+}
+
+void ClangFormatSettings::setSlowRequestThreshold(int milliseconds)
+{
+    m_slowRequestThreshold = milliseconds;
+}
+
+int ClangFormatSettings::slowRequestThreshold() const
+{
+    return m_slowRequestThreshold;
+}
+
+void ClangFormatSettings::setDocumentStateBudget(int megabytes)
+{
+    m_documentStateBudget = megabytes;
+}
+
+int ClangFormatSettings::documentStateBudget() const
+{
+    return m_documentStateBudget;
+}
+
+void ClangFormatSettings::setIndentationEngine(IndentationEngine engine)
+{
+    m_indentationEngine = engine;
+}
+
+ClangFormatSettings::IndentationEngine ClangFormatSettings::indentationEngine() const
+{
+    return m_indentationEngine;
+}
+
 } // namespace ClangFormat
@@ -30,18 +30,76 @@ public:
     void setFormatWhileTyping(bool enable);
     bool formatWhileTyping() const;
 
+    // How long the editor has to be idle before the code in front of a typed ';' or '}'
+    // is formatted. The indentation is applied immediately. 0 formats immediately as well.
+    void setFormatWhileTypingDelay(int milliseconds);
+    int formatWhileTypingDelay() const;
+
     void setFormatOnSave(bool enable);
     bool formatOnSave() const;
 
+    // Which lines are formatted on save. The Git based ones work like git clang-format and
+    // fall back to the edited lines for files outside of a Git work tree.
+    enum FormatOnSaveRanges {
+        EditedLines = 0,
+        ChangedSinceIndex,
+        ChangedSinceHead
+    };
+
+    void setFormatOnSaveRanges(FormatOnSaveRanges ranges);
+    FormatOnSaveRanges formatOnSaveRanges() const;
+
+    // Apply huge results of explicit formatting requests from the event loop in slices, so that
+    // the editor stays responsive. format() returns before they are applied then, so it is off
+    // by default. Formatting on save and programmatic formatting are always applied at once.
+    void setApplyFormattingInSlices(bool enable);
+    bool applyFormattingInSlices() const;
+
     void setFileSizeThreshold(int fileSizeInKb);
     int fileSizeThreshold() const;
 
+    // Derive the file size threshold from the measured clang-format speed, so that the
+    // indentation of a line is expected to take less than latencyTarget(). The fixed
+    // threshold is used until something was measured.
+    void setCalibrateFileSizeThreshold(bool enable);
+    bool calibrateFileSizeThreshold() const;
+    void setLatencyTarget(int milliseconds);
+    int latencyTarget() const;
+
+    // Indentation and formatting requests that take longer are saved for replaying.
+    // 0 disables the capturing.
+    void setSlowRequestThreshold(int milliseconds);
+    int slowRequestThreshold() const;
+
+    // How much the indenters of all open documents may cache, in MB. The least recently
+    // used documents drop their caches first.
+    void setDocumentStateBudget(int megabytes);
+    int documentStateBudget() const;
+
+    // Who computes the indentation after Enter and electric characters.
+    enum IndentationEngine {
+        ClangFormatEngine = 0,
+        NativeEngineVerified, // native, compared against clang-format when idle
+        NativeEngine
+    };
+
+    void setIndentationEngine(IndentationEngine engine);
+    IndentationEngine indentationEngine() const;
+
 private:
     Mode m_mode;
     bool m_useCustomSettings = false;
     bool m_formatWhileTyping = false;
+    int m_formatWhileTypingDelay = 0;
     bool m_formatOnSave = false;
+    FormatOnSaveRanges m_formatOnSaveRanges = EditedLines;
+    bool m_applyFormattingInSlices = false;
     int m_fileSizeThreshold = 200;
+    bool m_calibrateFileSizeThreshold = false;
+    int m_latencyTarget = 50;
+    int m_slowRequestThreshold = 0;
+    int m_documentStateBudget = 256;
+    IndentationEngine m_indentationEngine = ClangFormatEngine;
 };
 
 } // namespace ClangFormat
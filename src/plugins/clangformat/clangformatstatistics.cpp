@@ -0,0 +1,263 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatstatistics.h"
+
+#include "clangformatmemory.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QJsonArray>
+#include <QTextDocument>
+
+#include <algorithm>
+
+using namespace Utils;
+
+namespace ClangFormat::Statistics {
+
+namespace {
+
+// Old samples drop out, so that the view shows how the editor behaves now.
+const std::size_t windowSize = 1000;
+
+const char *const replacementsToKeepNames[] = {"OnlyIndent", "IndentAndBefore", "All"};
+const char *const routeNames[] = {"ClangFormat", "BuiltInDisabled", "BuiltInFileSize"};
+
+class Latencies
+{
+public:
+    void add(qint64 ns)
+    {
+        if (m_samples.size() < windowSize)
+            m_samples.push_back(ns);
+        else
+            m_samples[m_count % windowSize] = ns;
+        ++m_count;
+    }
+
+    qint64 bytes() const { return qint64(m_samples.capacity() * sizeof(qint64)); }
+
+    LatencySummary summary() const
+    {
+        LatencySummary result;
+        result.count = m_count;
+        result.histogram.assign(histogramBounds().size() + 1, 0);
+        if (m_samples.empty())
+            return result;
+
+        std::vector<qint64> sorted = m_samples;
+        std::sort(sorted.begin(), sorted.end());
+        const auto ms = [](qint64 ns) { return double(ns) / 1e6; };
+        result.medianMs = ms(sorted.at(sorted.size() / 2));
+        result.percentile95Ms = ms(sorted.at(sorted.size() * 95 / 100));
+        result.maxMs = ms(sorted.back());
+        for (const qint64 ns : sorted) {
+            const auto bound = std::upper_bound(histogramBounds().begin(),
+                                                histogramBounds().end(),
+                                                ms(ns));
+            ++result.histogram[std::distance(histogramBounds().begin(), bound)];
+        }
+        return result;
+    }
+
+private:
+    std::vector<qint64> m_samples;
+    qint64 m_count = 0;
+};
+
+struct DocumentStatistics
+{
+    FilePath filePath; // the latest one, documents can be saved under a new name
+    QMetaObject::Connection destroyedConnection;
+    Latencies indentation;
+    Latencies formatting;
+    int secondTries = 0;
+    int replacementsToKeep[3] = {};
+    int routes[int(Route::RouteCount)] = {};
+    qint64 reformatCalls = 0;
+    qint64 reformattedBytes = 0;
+};
+
+QHash<const QTextDocument *, DocumentStatistics> &documents()
+{
+    static QHash<const QTextDocument *, DocumentStatistics> documents;
+    static const bool registered = [] {
+        Memory::addCache(&documents, "Latency statistics", [] {
+            qint64 bytes = 0;
+            for (const DocumentStatistics &statistics : std::as_const(documents)) {
+                bytes += sizeof(DocumentStatistics) + statistics.indentation.bytes()
+                         + statistics.formatting.bytes()
+                         + statistics.filePath.toString().capacity() * sizeof(QChar);
+            }
+            return bytes;
+        });
+        return true;
+    }();
+    Q_UNUSED(registered)
+    return documents;
+}
+
+DocumentStatistics &statisticsFor(const QTextDocument *document, const FilePath &filePath)
+{
+    auto it = documents().find(document);
+    if (it == documents().end()) {
+        it = documents().insert(document, {});
+        it->destroyedConnection = QObject::connect(document, &QObject::destroyed, [document] {
+            documents().remove(document);
+        });
+    }
+    it->filePath = filePath;
+    return *it;
+}
+
+QJsonObject toJson(const LatencySummary &summary)
+{
+    QJsonObject histogram;
+    const std::vector<int> &bounds = histogramBounds();
+    for (std::size_t i = 0; i < summary.histogram.size(); ++i) {
+        const QString bucket = i < bounds.size() ? QString("<%1ms").arg(bounds.at(i))
+                                                 : QString(">=%1ms").arg(bounds.back());
+        histogram.insert(bucket, summary.histogram.at(i));
+    }
+    return {{"count", summary.count},
+            {"medianMs", summary.medianMs},
+            {"p95Ms", summary.percentile95Ms},
+            {"maxMs", summary.maxMs},
+            {"histogram", histogram}};
+}
+
+StartupSummary &startupSummary()
+{
+    static StartupSummary summary;
+    return summary;
+}
+
+} // namespace
+
+void recordIndentation(const QTextDocument *document,
+                       const FilePath &filePath,
+                       ReplacementsToKeep replacementsToKeep,
+                       qint64 totalNs,
+                       qint64 reformattedBytes,
+                       bool secondTry)
+{
+    DocumentStatistics &statistics = statisticsFor(document, filePath);
+    statistics.indentation.add(totalNs);
+    ++statistics.replacementsToKeep[int(replacementsToKeep)];
+    if (secondTry)
+        ++statistics.secondTries;
+    ++statistics.reformatCalls;
+    statistics.reformattedBytes += reformattedBytes;
+}
+
+void recordFormatting(const QTextDocument *document,
+                      const FilePath &filePath,
+                      qint64 totalNs,
+                      qint64 reformattedBytes)
+{
+    DocumentStatistics &statistics = statisticsFor(document, filePath);
+    statistics.formatting.add(totalNs);
+    ++statistics.replacementsToKeep[int(ReplacementsToKeep::All)];
+    ++statistics.reformatCalls;
+    statistics.reformattedBytes += reformattedBytes;
+}
+
+void recordRoute(const QTextDocument *document, const FilePath &filePath, Route route)
+{
+    ++statisticsFor(document, filePath).routes[int(route)];
+}
+
+void recordStartup(StartupEvent event, qint64 msSincePluginInitialize)
+{
+    StartupSummary &summary = startupSummary();
+    switch (event) {
+    case StartupEvent::PluginInitialized:
+        summary.pluginInitializeMs = msSincePluginInitialize;
+        break;
+    case StartupEvent::FirstIndenterCreated:
+        summary.firstIndenterCreatedMs = msSincePluginInitialize;
+        break;
+    case StartupEvent::FirstIndentRequested:
+        summary.firstIndentRequestedMs = msSincePluginInitialize;
+        break;
+    case StartupEvent::FirstIndentFinished:
+        summary.firstIndentFinishedMs = msSincePluginInitialize;
+        break;
+    }
+}
+
+const std::vector<int> &histogramBounds()
+{
+    static const std::vector<int> bounds{1, 2, 5, 10, 20, 50, 100, 200, 500};
+    return bounds;
+}
+
+std::vector<DocumentSummary> summaries()
+{
+    std::vector<DocumentSummary> result;
+    result.reserve(documents().size());
+    for (auto it = documents().cbegin(); it != documents().cend(); ++it) {
+        DocumentSummary summary;
+        summary.filePath = it->filePath;
+        summary.indentation = it->indentation.summary();
+        summary.formatting = it->formatting.summary();
+        summary.secondTries = it->secondTries;
+        std::copy(std::begin(it->replacementsToKeep),
+                  std::end(it->replacementsToKeep),
+                  std::begin(summary.replacementsToKeep));
+        std::copy(std::begin(it->routes), std::end(it->routes), std::begin(summary.routes));
+        summary.reformatCalls = it->reformatCalls;
+        summary.reformattedBytes = it->reformattedBytes;
+        result.push_back(summary);
+    }
+    std::sort(result.begin(), result.end(), [](const auto &first, const auto &second) {
+        return first.filePath < second.filePath;
+    });
+    return result;
+}
+
+StartupSummary startup()
+{
+    return startupSummary();
+}
+
+QJsonObject toJson()
+{
+    QJsonArray documentsArray;
+    for (const DocumentSummary &summary : summaries()) {
+        QJsonObject modes;
+        for (int i = 0; i < 3; ++i)
+            modes.insert(replacementsToKeepNames[i], summary.replacementsToKeep[i]);
+        QJsonObject routes;
+        for (int i = 0; i < int(Route::RouteCount); ++i)
+            routes.insert(routeNames[i], summary.routes[i]);
+        documentsArray.append(QJsonObject{
+            {"file", summary.filePath.toUserOutput()},
+            {"indentation", toJson(summary.indentation)},
+            {"formatting", toJson(summary.formatting)},
+            {"secondTries", summary.secondTries},
+            {"replacementsToKeep", modes},
+            {"routes", routes},
+            {"reformatCalls", summary.reformatCalls},
+            {"reformattedBytes", summary.reformattedBytes}});
+    }
+    const StartupSummary &startup = startupSummary();
+    const QJsonObject startupObject{{"pluginInitializeMs", startup.pluginInitializeMs},
+                                    {"firstIndenterCreatedMs", startup.firstIndenterCreatedMs},
+                                    {"firstIndentRequestedMs", startup.firstIndentRequestedMs},
+                                    {"firstIndentFinishedMs", startup.firstIndentFinishedMs}};
+    return {{"created", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+            {"windowSize", int(windowSize)},
+            {"startup", startupObject},
+            {"documents", documentsArray}};
+}
+
+void reset()
+{
+    for (const DocumentStatistics &statistics : std::as_const(documents()))
+        QObject::disconnect(statistics.destroyedConnection);
+    documents().clear();
+}
+
+} // namespace ClangFormat::Statistics
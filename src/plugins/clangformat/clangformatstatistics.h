@@ -0,0 +1,89 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include "clangformatformatter.h"
+
+#include <utils/filepath.h>
+
+#include <QJsonObject>
+
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+class QTextDocument;
+QT_END_NAMESPACE
+
+// Per document latencies of the indenter for the statistics view, so that "typing is laggy"
+// can be looked at. Fed by ClangFormatBaseIndenter and ClangFormatForwardingIndenter.
+// Documents are told apart even without a file name, and are dropped when they are closed.
+// Main thread only.
+
+namespace ClangFormat::Statistics {
+
+// Which indenter ClangFormatForwardingIndenter routes requests to, and why.
+enum class Route { ClangFormat, BuiltInDisabled, BuiltInFileSize, RouteCount };
+
+void recordIndentation(const QTextDocument *document,
+                       const Utils::FilePath &filePath,
+                       ReplacementsToKeep replacementsToKeep,
+                       qint64 totalNs,
+                       qint64 reformattedBytes,
+                       bool secondTry);
+void recordFormatting(const QTextDocument *document,
+                      const Utils::FilePath &filePath,
+                      qint64 totalNs,
+                      qint64 reformattedBytes);
+// Called when the route of the document changes, not for every request.
+void recordRoute(const QTextDocument *document, const Utils::FilePath &filePath, Route route);
+
+// Once per session, see clangformatbenchmark.h.
+enum class StartupEvent {
+    PluginInitialized,
+    FirstIndenterCreated,
+    FirstIndentRequested,
+    FirstIndentFinished
+};
+void recordStartup(StartupEvent event, qint64 msSincePluginInitialize);
+
+// Upper bounds of the histogram buckets in milliseconds, the last bucket has none.
+const std::vector<int> &histogramBounds();
+
+struct LatencySummary
+{
+    qint64 count = 0;           // since the document was first seen
+    double medianMs = 0;        // of the rolling window, like the rest
+    double percentile95Ms = 0;
+    double maxMs = 0;
+    std::vector<int> histogram; // one more entry than histogramBounds()
+};
+
+struct DocumentSummary
+{
+    Utils::FilePath filePath; // empty for unsaved documents
+    LatencySummary indentation;
+    LatencySummary formatting;
+    int secondTries = 0;
+    int replacementsToKeep[3] = {};
+    int routes[int(Route::RouteCount)] = {}; // how often the route changed to each
+    qint64 reformatCalls = 0;
+    qint64 reformattedBytes = 0;
+};
+
+// In milliseconds after the plugin initialization started, -1 for what did not happen yet.
+// Not cleared by reset().
+struct StartupSummary
+{
+    qint64 pluginInitializeMs = -1;
+    qint64 firstIndenterCreatedMs = -1;
+    qint64 firstIndentRequestedMs = -1;
+    qint64 firstIndentFinishedMs = -1;
+};
+
+std::vector<DocumentSummary> summaries();
+StartupSummary startup();
+QJsonObject toJson();
+void reset();
+
+} // namespace ClangFormat::Statistics
@@ -0,0 +1,196 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformatstatisticsview.h"
+
+#include "clangformatstatistics.h"
+#include "clangformattr.h"
+
+#include <coreplugin/icore.h>
+
+#include <utils/fileutils.h>
+#include <utils/layoutbuilder.h>
+
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QHeaderView>
+#include <QJsonDocument>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPointer>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeWidget>
+
+#include <algorithm>
+
+using namespace Utils;
+
+namespace ClangFormat {
+
+namespace {
+
+QString histogramText(const std::vector<int> &histogram)
+{
+    // One bar per bucket, scaled to the fullest one.
+    static const QString bars = QString::fromUtf8("▁▂▃▄▅▆▇█");
+    const int maximum = histogram.empty() ? 0 : *std::max_element(histogram.begin(),
+                                                                  histogram.end());
+    QString text;
+    for (const int count : histogram) {
+        if (count == 0 || maximum == 0)
+            text += ' ';
+        else
+            text += bars.at((count * (bars.size() - 1) + maximum - 1) / maximum);
+    }
+    return text;
+}
+
+QString latencyText(const Statistics::LatencySummary &summary)
+{
+    if (summary.count == 0)
+        return {};
+    return Tr::tr("%1 calls, median %2 ms, p95 %3 ms, max %4 ms")
+        .arg(summary.count)
+        .arg(summary.medianMs, 0, 'f', 1)
+        .arg(summary.percentile95Ms, 0, 'f', 1)
+        .arg(summary.maxMs, 0, 'f', 1);
+}
+
+QString startupText(const Statistics::StartupSummary &startup)
+{
+    const auto ms = [](qint64 value) {
+        return value < 0 ? Tr::tr("not yet") : Tr::tr("%1 ms").arg(value);
+    };
+    return Tr::tr("Plugin initialization: %1, first indenter: %2, first indentation request: "
+                  "%3, first indentation: %4 (after the plugin initialization started)")
+        .arg(ms(startup.pluginInitializeMs),
+             ms(startup.firstIndenterCreatedMs),
+             ms(startup.firstIndentRequestedMs),
+             ms(startup.firstIndentFinishedMs));
+}
+
+class StatisticsView final : public QDialog
+{
+public:
+    StatisticsView()
+        : QDialog(Core::ICore::dialogParent())
+    {
+        setWindowTitle(Tr::tr("ClangFormat Latency Statistics"));
+        setAttribute(Qt::WA_DeleteOnClose);
+        resize(1100, 400);
+
+        QStringList bucketNames;
+        for (const int bound : Statistics::histogramBounds())
+            bucketNames << QString::number(bound);
+        const QString histogramHeader = Tr::tr("Histogram (ms: %1)").arg(bucketNames.join(' '));
+
+        m_startupLabel = new QLabel;
+        m_startupLabel->setWordWrap(true);
+
+        m_tree = new QTreeWidget;
+        m_tree->setRootIsDecorated(false);
+        m_tree->setHeaderLabels({Tr::tr("Document"),
+                                 Tr::tr("Indentation"),
+                                 histogramHeader,
+                                 Tr::tr("Formatting"),
+                                 histogramHeader,
+                                 Tr::tr("Second Tries"),
+                                 Tr::tr("Only Indent / Indent and Before / All"),
+                                 Tr::tr("Routed to ClangFormat / Disabled / File Size"),
+                                 Tr::tr("Bytes per Call")});
+        m_tree->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+        auto buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+        QPushButton *exportButton = buttons->addButton(Tr::tr("Export JSON..."),
+                                                       QDialogButtonBox::ActionRole);
+        QPushButton *resetButton = buttons->addButton(Tr::tr("Reset"),
+                                                      QDialogButtonBox::ResetRole);
+        connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+        connect(exportButton, &QPushButton::clicked, this, &StatisticsView::exportJson);
+        connect(resetButton, &QPushButton::clicked, this, [this] {
+            Statistics::reset();
+            refresh();
+        });
+
+        using namespace Layouting;
+        Column {
+            m_startupLabel,
+            m_tree,
+            buttons,
+        }.attachTo(this);
+
+        connect(&m_refreshTimer, &QTimer::timeout, this, &StatisticsView::refresh);
+        m_refreshTimer.start(1000);
+        refresh();
+    }
+
+private:
+    void refresh()
+    {
+        m_startupLabel->setText(startupText(Statistics::startup()));
+        m_tree->clear();
+        for (const Statistics::DocumentSummary &summary : Statistics::summaries()) {
+            const qint64 bytesPerCall = summary.reformatCalls == 0
+                                            ? 0
+                                            : summary.reformattedBytes / summary.reformatCalls;
+            const QString document = summary.filePath.isEmpty()
+                                         ? Tr::tr("Untitled")
+                                         : summary.filePath.toUserOutput();
+            auto item = new QTreeWidgetItem(
+                {document,
+                 latencyText(summary.indentation),
+                 histogramText(summary.indentation.histogram),
+                 latencyText(summary.formatting),
+                 histogramText(summary.formatting.histogram),
+                 QString::number(summary.secondTries),
+                 QString("%1 / %2 / %3")
+                     .arg(summary.replacementsToKeep[int(ReplacementsToKeep::OnlyIndent)])
+                     .arg(summary.replacementsToKeep[int(ReplacementsToKeep::IndentAndBefore)])
+                     .arg(summary.replacementsToKeep[int(ReplacementsToKeep::All)]),
+                 QString("%1 / %2 / %3")
+                     .arg(summary.routes[int(Statistics::Route::ClangFormat)])
+                     .arg(summary.routes[int(Statistics::Route::BuiltInDisabled)])
+                     .arg(summary.routes[int(Statistics::Route::BuiltInFileSize)]),
+                 QString::number(bytesPerCall)});
+            item->setToolTip(0, document);
+            m_tree->addTopLevelItem(item);
+        }
+    }
+
+    void exportJson()
+    {
+        const FilePath filePath = FileUtils::getSaveFilePath(this,
+                                                             Tr::tr("Export Latency Statistics"),
+                                                             FileUtils::homePath(),
+                                                             Tr::tr("JSON (*.json);;All files (*)"));
+        if (filePath.isEmpty())
+            return;
+        const expected_str<qint64> result = filePath.writeFileContents(
+            QJsonDocument(Statistics::toJson()).toJson());
+        if (!result) {
+            QMessageBox::warning(this,
+                                 Tr::tr("Export Latency Statistics"),
+                                 Tr::tr("Cannot write \"%1\": %2")
+                                     .arg(filePath.toUserOutput(), result.error()));
+        }
+    }
+
+    QLabel *m_startupLabel = nullptr;
+    QTreeWidget *m_tree = nullptr;
+    QTimer m_refreshTimer;
+};
+
+} // namespace
+
+void showStatisticsView()
+{
+    static QPointer<StatisticsView> view;
+    if (!view)
+        view = new StatisticsView;
+    view->show();
+    view->raise();
+    view->activateWindow();
+}
+
+} // namespace ClangFormat
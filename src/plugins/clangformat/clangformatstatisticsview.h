@@ -0,0 +1,11 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+namespace ClangFormat {
+
+// Shows the latency statistics of the indenter per document, refreshed while open.
+void showStatisticsView();
+
+} // namespace ClangFormat
@@ -0,0 +1,30 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <utils/filepath.h>
+
+#include <clang/Format/Format.h>
+
+// How the editor decides on the style of a file, without the settings and projects of the IDE.
+// Only depends on Utils and clang-format, so that the clangformatcli tool resolves styles
+// exactly like formatStyleForFile() in clangformatutils.h, which adds the IDE's settings.
+
+namespace ClangFormat {
+
+void addQtcStatementMacros(clang::format::FormatStyle &style);
+const clang::format::FormatStyle &qtcStyle();
+
+// The .clang-format file that the ClangFormat tab of the code style settings writes for the
+// code style named \a codeStyleDisplayName, below the user resource path of the IDE.
+Utils::FilePath codeStyleSettingsFile(const Utils::FilePath &userResourcePath,
+                                      const QString &codeStyleDisplayName);
+
+// The .clang-format file found for \a filePath, unless \a overrideStyleFile is set or there
+// is none. Then the style in \a codeStyleSettingsFile, or the Qt style if that is missing.
+clang::format::FormatStyle resolveFormatStyle(const Utils::FilePath &filePath,
+                                              bool overrideStyleFile,
+                                              const Utils::FilePath &codeStyleSettingsFile);
+
+} // namespace ClangFormat
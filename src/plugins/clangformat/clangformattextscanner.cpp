@@ -0,0 +1,79 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "clangformattextscanner.h"
+
+#include "clangformatmemory.h"
+
+#include <QHash>
+
+namespace ClangFormat::Internal {
+
+namespace {
+
+struct DocumentText
+{
+    QString text;
+    int revision = -1;
+    // contentsChange() comes at the end of an edit block. Changes within one are noticed by
+    // the character count, and documentBuffer() takes the text again for every request.
+    bool outdated = true;
+};
+
+QHash<const QTextDocument *, DocumentText> &documentTexts()
+{
+    static QHash<const QTextDocument *, DocumentText> documentTexts;
+    static const bool registered = [] {
+        Memory::addCache(&documentTexts, "Scanned document texts", [] {
+            qint64 bytes = 0;
+            for (const DocumentText &documentText : std::as_const(documentTexts))
+                bytes += documentText.text.capacity() * qint64(sizeof(QChar));
+            return bytes;
+        });
+        return true;
+    }();
+    Q_UNUSED(registered)
+    return documentTexts;
+}
+
+DocumentText &documentTextEntry(const QTextDocument *doc)
+{
+    auto it = documentTexts().find(doc);
+    if (it == documentTexts().end()) {
+        it = documentTexts().insert(doc, {});
+        QObject::connect(doc, &QTextDocument::contentsChange, doc, [doc] {
+            DocumentText &documentText = documentTexts()[doc];
+            documentText.text = QString();
+            documentText.outdated = true;
+        });
+        QObject::connect(doc, &QObject::destroyed, [doc] { documentTexts().remove(doc); });
+    }
+    return *it;
+}
+
+QStringView takeDocumentText(const QTextDocument *doc, DocumentText &documentText)
+{
+    documentText.text = doc->toPlainText();
+    documentText.revision = doc->revision();
+    documentText.outdated = false;
+    return documentText.text;
+}
+
+} // namespace
+
+QStringView documentText(const QTextDocument *doc)
+{
+    DocumentText &documentText = documentTextEntry(doc);
+    if (documentText.outdated || documentText.revision != doc->revision()
+        || documentText.text.size() + 1 != doc->characterCount()) {
+        return takeDocumentText(doc, documentText);
+    }
+    return documentText.text;
+}
+
+QStringView currentDocumentText(const QTextDocument *doc)
+{
+    return takeDocumentText(doc, documentTextEntry(doc));
+}
+
+} // namespace ClangFormat::Internal
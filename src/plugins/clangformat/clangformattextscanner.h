@@ -0,0 +1,101 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <QStringView>
+#include <QTextBlock>
+#include <QTextDocument>
+
+#include <algorithm>
+
+namespace ClangFormat::Internal {
+
+// The plain text of doc, in which a position in the document is an index, with '\n' for the
+// paragraph separators. It is taken once after every change of the contents and shared by all
+// scanners of the document, so looking at blocks and characters does not allocate. The view is
+// valid until the document changes. Main thread only.
+QStringView documentText(const QTextDocument *doc);
+// Takes the text again, even if the document does not seem to have changed, e.g. for the
+// buffer that is passed to clang-format.
+QStringView currentDocumentText(const QTextDocument *doc);
+
+// The text of a block as a view into documentText(), so trimming and taking prefixes do not
+// allocate either.
+class BlockText
+{
+public:
+    explicit BlockText(const QTextBlock &block)
+    {
+        if (!block.isValid())
+            return;
+        const QStringView text = documentText(block.document());
+        const int position = std::min(block.position(), int(text.size()));
+        m_text = text.mid(position, std::min(block.length() - 1, int(text.size()) - position));
+    }
+
+    QStringView view() const { return m_text; }
+    QStringView trimmed() const { return view().trimmed(); }
+    QStringView left(int length) const { return view().left(length); }
+    bool isBlank() const { return firstNonSpace() < 0; }
+
+    int firstNonSpace() const
+    {
+        for (int i = 0; i < m_text.size(); ++i) {
+            if (!m_text.at(i).isSpace())
+                return i;
+        }
+        return -1;
+    }
+
+private:
+    QStringView m_text;
+};
+
+inline bool isBlankBlock(const QTextBlock &block)
+{
+    return BlockText(block).isBlank();
+}
+
+// Walks over the characters of a document like QTextDocument::characterAt(), but on
+// documentText() instead of looking up the piece table for every character. The position
+// after the last character of a block is its paragraph separator, a '\n'.
+class DocumentScanner
+{
+public:
+    DocumentScanner(const QTextDocument *doc, int position)
+        : m_text(documentText(doc))
+        , m_position(position)
+    {}
+
+    bool isValid() const { return m_position >= 0 && m_position <= m_text.size(); }
+    int position() const { return m_position; }
+
+    QChar character() const
+    {
+        return m_position < m_text.size() ? m_text.at(m_position) : QChar('\n');
+    }
+
+    // Return false if there is no character to move to, the position is unchanged then.
+    bool previous()
+    {
+        if (m_position <= 0 || !isValid())
+            return false;
+        --m_position;
+        return true;
+    }
+
+    bool next()
+    {
+        if (!isValid() || m_position >= m_text.size())
+            return false;
+        ++m_position;
+        return true;
+    }
+
+private:
+    QStringView m_text;
+    int m_position = 0;
+};
+
+} // namespace ClangFormat::Internal
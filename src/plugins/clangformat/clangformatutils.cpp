@@ -26,6 +26,7 @@
 #include "clangformatutils.h"
 
 #include "clangformatconstants.h"
+#include "clangformatprojectindex.h"
 #include "clangformatsettings.h"
 
 #include <coreplugin/icore.h>
@@ -33,6 +34,7 @@
 #include <texteditor/icodestylepreferences.h>
 #include <texteditor/tabsettings.h>
 #include <texteditor/texteditorsettings.h>
+#include <projectexplorer/editorconfiguration.h>
 #include <projectexplorer/project.h>
 #include <projectexplorer/session.h>
 #include <utils/qtcassert.h>
@@ -49,191 +51,6 @@ using namespace Utils;
 
 namespace ClangFormat {
 
-clang::format::FormatStyle qtcStyle()
-{
-    clang::format::FormatStyle style = getLLVMStyle();
-    style.Language = FormatStyle::LK_Cpp;
-    style.AccessModifierOffset = -4;
-#if LLVM_VERSION_MAJOR >= 22
-    style.AlignAfterOpenBracket = true;
-#else
-    style.AlignAfterOpenBracket = FormatStyle::BAS_Align;
-#endif
-    style.AlignEscapedNewlines = FormatStyle::ENAS_DontAlign;
-#if LLVM_VERSION_MAJOR >= 20
-    style.AlignConsecutiveAssignments = {false, false, false, false, false, false, false};
-    style.AlignConsecutiveDeclarations = {false, false, false, false, false, false, false};
-#elif LLVM_VERSION_MAJOR >= 18
-    style.AlignConsecutiveAssignments = {false, false, false, false, false, false};
-    style.AlignConsecutiveDeclarations = {false, false, false, false, false, false};
-#elif LLVM_VERSION_MAJOR >= 15
-    style.AlignConsecutiveAssignments = {false, false, false, false, false};
-    style.AlignConsecutiveDeclarations = {false, false, false, false, false};
-#else
-    style.AlignConsecutiveAssignments = FormatStyle::ACS_None;
-    style.AlignConsecutiveDeclarations = FormatStyle::ACS_None;
-#endif
-#if LLVM_VERSION_MAJOR >= 11
-    style.AlignOperands = FormatStyle::OAS_Align;
-#else
-    style.AlignOperands = true;
-#endif
-#if LLVM_VERSION_MAJOR >= 16
-    style.AlignTrailingComments = {FormatStyle::TCAS_Always, 0};
-#else
-    style.AlignTrailingComments = true;
-#endif
-    style.AllowAllParametersOfDeclarationOnNextLine = true;
-#if LLVM_VERSION_MAJOR >= 10
-    style.AllowShortBlocksOnASingleLine = FormatStyle::SBS_Never;
-#else
-    style.AllowShortBlocksOnASingleLine = false;
-#endif
-    style.AllowShortCaseLabelsOnASingleLine = false;
-    style.AllowShortFunctionsOnASingleLine = FormatStyle::SFS_Inline;
-#if LLVM_VERSION_MAJOR >= 9
-    style.AllowShortIfStatementsOnASingleLine = FormatStyle::SIS_Never;
-#else
-    style.AllowShortIfStatementsOnASingleLine = false;
-#endif
-    style.AllowShortLoopsOnASingleLine = false;
-#if LLVM_VERSION_MAJOR >= 19
-    style.BreakAfterReturnType = FormatStyle::RTBS_None;
-    style.BreakTemplateDeclarations = FormatStyle::BTDS_Yes;
-#else
-    style.AlwaysBreakAfterReturnType = FormatStyle::RTBS_None;
-    style.AlwaysBreakTemplateDeclarations = FormatStyle::BTDS_Yes;
-#endif
-    style.AlwaysBreakBeforeMultilineStrings = false;
-    style.BinPackArguments = false;
-#if LLVM_VERSION_MAJOR >= 20
-    style.BinPackParameters = FormatStyle::BPPS_OnePerLine;
-#else
-    style.BinPackParameters = false;
-#endif
-    style.BraceWrapping.AfterClass = true;
-#if LLVM_VERSION_MAJOR >= 10
-    style.BraceWrapping.AfterControlStatement = FormatStyle::BWACS_Never;
-#else
-    style.BraceWrapping.AfterControlStatement = false;
-#endif
-    style.BraceWrapping.AfterEnum = false;
-    style.BraceWrapping.AfterFunction = true;
-    style.BraceWrapping.AfterNamespace = false;
-    style.BraceWrapping.AfterObjCDeclaration = false;
-    style.BraceWrapping.AfterStruct = true;
-    style.BraceWrapping.AfterUnion = false;
-    style.BraceWrapping.BeforeCatch = false;
-    style.BraceWrapping.BeforeElse = false;
-    style.BraceWrapping.IndentBraces = false;
-    style.BraceWrapping.SplitEmptyFunction = false;
-    style.BraceWrapping.SplitEmptyRecord = false;
-    style.BraceWrapping.SplitEmptyNamespace = false;
-    style.BreakBeforeBinaryOperators = FormatStyle::BOS_All;
-    style.BreakBeforeBraces = FormatStyle::BS_Custom;
-    style.BreakBeforeTernaryOperators = true;
-    style.BreakConstructorInitializers = FormatStyle::BCIS_BeforeComma;
-    style.BreakAfterJavaFieldAnnotations = false;
-    style.BreakStringLiterals = true;
-    style.ColumnLimit = 100;
-    style.CommentPragmas = "^ IWYU pragma:";
-    style.CompactNamespaces = false;
-#if LLVM_VERSION_MAJOR >= 15
-    style.PackConstructorInitializers = FormatStyle::PCIS_BinPack;
-#else
-    style.ConstructorInitializerAllOnOneLineOrOnePerLine = false;
-#endif
-    style.ConstructorInitializerIndentWidth = 4;
-    style.ContinuationIndentWidth = 4;
-#if LLVM_VERSION_MAJOR >= 22
-    style.Cpp11BracedListStyle = FormatStyle::BLS_FunctionCall;
-#else
-    style.Cpp11BracedListStyle = true;
-#endif
-    style.DerivePointerAlignment = false;
-    style.DisableFormat = false;
-    style.ExperimentalAutoDetectBinPacking = false;
-    style.FixNamespaceComments = true;
-    style.ForEachMacros = {"forever", "foreach", "Q_FOREACH", "BOOST_FOREACH"};
-#if LLVM_VERSION_MAJOR >= 12
-    style.IncludeStyle.IncludeCategories = {{"^<Q.*", 200, 200, true}};
-#else
-    style.IncludeStyle.IncludeCategories = {{"^<Q.*", 200, 200}};
-#endif
-    style.IncludeStyle.IncludeIsMainRegex = "(Test)?$";
-    style.IndentCaseLabels = false;
-    style.IndentWidth = 4;
-    style.IndentWrappedFunctionNames = false;
-    style.JavaScriptQuotes = FormatStyle::JSQS_Leave;
-    style.JavaScriptWrapImports = true;
-#if LLVM_VERSION_MAJOR >= 19
-    style.KeepEmptyLines = {false, false, false};
-#else
-    style.KeepEmptyLinesAtTheStartOfBlocks = false;
-#endif
-    // Do not add QT_BEGIN_NAMESPACE/QT_END_NAMESPACE as this will indent lines in between.
-    style.MacroBlockBegin = "";
-    style.MacroBlockEnd = "";
-    style.MaxEmptyLinesToKeep = 1;
-    style.NamespaceIndentation = FormatStyle::NI_None;
-    style.ObjCBlockIndentWidth = 4;
-    style.ObjCSpaceAfterProperty = false;
-    style.ObjCSpaceBeforeProtocolList = true;
-    style.PenaltyBreakAssignment = 150;
-    style.PenaltyBreakBeforeFirstCallParameter = 300;
-    style.PenaltyBreakComment = 500;
-    style.PenaltyBreakFirstLessLess = 400;
-    style.PenaltyBreakString = 600;
-    style.PenaltyExcessCharacter = 50;
-    style.PenaltyReturnTypeOnItsOwnLine = 300;
-    style.PointerAlignment = FormatStyle::PAS_Right;
-#if LLVM_VERSION_MAJOR >= 20
-    style.ReflowComments = FormatStyle::RCS_Never;
-#else
-    style.ReflowComments = false;
-#endif
-#if LLVM_VERSION_MAJOR > 20
-    style.SortIncludes = {.Enabled = true, .IgnoreCase = false};
-#elif LLVM_VERSION_MAJOR >= 13
-    style.SortIncludes = FormatStyle::SI_CaseSensitive;
-#else
-    style.SortIncludes = true;
-#endif
-#if LLVM_VERSION_MAJOR >= 16
-    style.SortUsingDeclarations = FormatStyle::SUD_Lexicographic;
-#else
-    style.SortUsingDeclarations = true;
-#endif
-    style.SpaceAfterCStyleCast = true;
-    style.SpaceAfterTemplateKeyword = false;
-    style.SpaceBeforeAssignmentOperators = true;
-    style.SpaceBeforeParens = FormatStyle::SBPO_ControlStatements;
-#if LLVM_VERSION_MAJOR < 17
-    style.SpaceInEmptyParentheses = false;
-#endif
-    style.SpacesBeforeTrailingComments = 1;
-#if LLVM_VERSION_MAJOR >= 13
-    style.SpacesInAngles = FormatStyle::SIAS_Never;
-#else
-    style.SpacesInAngles = false;
-#endif
-    style.SpacesInContainerLiterals = false;
-#if LLVM_VERSION_MAJOR >= 17
-    style.SpacesInParens = FormatStyle::SIPO_Never;
-#else
-    style.SpacesInCStyleCastParentheses = false;
-    style.SpacesInParentheses = false;
-#endif
-    style.SpacesInSquareBrackets = false;
-    style.StatementMacros.emplace_back("Q_OBJECT");
-    style.StatementMacros.emplace_back("QT_BEGIN_NAMESPACE");
-    style.StatementMacros.emplace_back("QT_END_NAMESPACE");
-    style.Standard = FormatStyle::LS_Cpp11;
-    style.TabWidth = 4;
-    style.UseTab = FormatStyle::UT_Never;
-    return style;
-}
-
 static bool useGlobalOverriddenSettings()
 {
     return ClangFormatSettings::instance().overrideDefaultFile();
@@ -421,23 +238,38 @@ clang::format::FormatStyle styleForFile(Utils::FilePath fileName)
     return styleForFile(fileName, true);
 }
 
-void addQtcStatementMacros(clang::format::FormatStyle &style)
+Utils::FilePath filePathToCurrentSettings(const TextEditor::ICodeStylePreferences *codeStyle)
 {
-    static const std::vector<std::string> macros = {"Q_OBJECT",
-                                                    "QT_BEGIN_NAMESPACE",
-                                                    "QT_END_NAMESPACE"};
-    for (const std::string &macro : macros) {
-        if (std::find(style.StatementMacros.begin(), style.StatementMacros.end(), macro)
-            == style.StatementMacros.end())
-            style.StatementMacros.emplace_back(macro);
-    }
+    return codeStyleSettingsFile(Core::ICore::userResourcePath(), codeStyle->displayName());
 }
 
-Utils::FilePath filePathToCurrentSettings(const TextEditor::ICodeStylePreferences *codeStyle)
+clang::format::FormatStyle formatStyleForFile(const Utils::FilePath &filePath)
+{
+    const ProjectExplorer::Project *project = projectForFile(filePath);
+    const bool overrideStyleFile
+        = project ? project->namedSettings(Constants::OVERRIDE_FILE_ID).toBool()
+                  : ClangFormatSettings::instance().overrideDefaultFile();
+    const TextEditor::ICodeStylePreferences *preferences
+        = project ? project->editorConfiguration()->codeStyle("Cpp")->currentPreferences()
+                  : TextEditor::TextEditorSettings::codeStyle("Cpp")->currentPreferences();
+
+    return resolveFormatStyle(filePath, overrideStyleFile, filePathToCurrentSettings(preferences));
+}
+
+static int &currentStyleGeneration()
+{
+    static int generation = 0;
+    return generation;
+}
+
+int styleGeneration()
+{
+    return currentStyleGeneration();
+}
+
+void invalidateStyles()
 {
-    return Core::ICore::userResourcePath() / "clang-format/"
-           / Utils::FileUtils::fileSystemFriendlyName(codeStyle->displayName())
-           / QLatin1String(Constants::SETTINGS_FILE_NAME);
+    ++currentStyleGeneration();
 }
 
 std::string readFile(const QString &path)
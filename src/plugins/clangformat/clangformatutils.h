@@ -4,6 +4,7 @@
 #pragma once
 
 #include "clangformatsettings.h"
+#include "clangformatstyleresolution.h"
 
 #include <utils/filepath.h>
 #include <utils/id.h>
@@ -42,12 +43,20 @@ void fromCppCodeStyleSettings(clang::format::FormatStyle &style,
 
 bool getProjectCustomSettings(const ProjectExplorer::Project *project);
 
-void addQtcStatementMacros(clang::format::FormatStyle &style);
-clang::format::FormatStyle qtcStyle();
 clang::format::FormatStyle currentQtStyle(const TextEditor::ICodeStylePreferences *codeStyle);
 
 Utils::FilePath filePathToCurrentSettings(const TextEditor::ICodeStylePreferences *codeStyle);
 
+// The style the editor uses for the file: the .clang-format file found for it, unless the
+// project or global settings override it, and the code style settings otherwise.
+clang::format::FormatStyle formatStyleForFile(const Utils::FilePath &filePath);
+
+// Changes whenever something formatStyleForFile() depends on may have changed: the settings,
+// the code style files of the IDE or a .clang-format file saved in the editor. Resolved styles
+// can be kept until then.
+int styleGeneration();
+void invalidateStyles();
+
 Utils::expected_str<void> parseConfigurationContent(const std::string &fileContent,
                                                     clang::format::FormatStyle &style,
                                                     bool allowUnknownOptions = false);
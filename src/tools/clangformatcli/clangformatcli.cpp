@@ -0,0 +1,359 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+// Formats or checks files like the ClangFormat plugin of Qt Creator does, for CI and
+// pre-commit hooks. Styles are resolved with the code of the plugin: the .clang-format file
+// found for a file, unless the ClangFormat settings of the code style override it, which are
+// read from the settings directory of Qt Creator. Whether they override it is decided per
+// project like in the IDE: by the .shared and .user files of the project that a file is in,
+// and for files outside of projects by the global setting.
+//
+//   clangformatcli --check -j 8 $(git diff --name-only --cached -- '*.cpp' '*.h')
+
+#include "clangformatconstants.h"
+#include "clangformatformatter.h"
+#include "clangformatstyleresolution.h"
+
+#include <utils/persistentsettings.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QSaveFile>
+#include <QSettings>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+
+using namespace ClangFormat;
+using namespace Utils;
+
+namespace {
+
+struct Options
+{
+    bool check = false;
+    // --override-style-file, for all files.
+    bool forceOverrideStyleFile = false;
+    // --project-settings, for all files instead of the projects that they are in.
+    std::optional<bool> projectOverrideStyleFile;
+    // For files outside of projects.
+    bool globalOverrideStyleFile = false;
+    FilePath codeStyleSettingsFile;
+};
+
+// The override setting of the ClangFormat tab of a project, which Project::namedSettings()
+// reads from the plugin settings of its .user file, or its .shared file, whose values win.
+// Not set if settingsFile cannot be read or does not contain it.
+std::optional<bool> overrideStyleFileSetting(const FilePath &settingsFile)
+{
+    PersistentSettingsReader reader;
+    if (!reader.load(settingsFile))
+        return {};
+    const QVariantMap pluginSettings
+        = reader.restoreValue("ProjectExplorer.Project.PluginSettings").toMap();
+    const auto it = pluginSettings.constFind(Constants::USE_CUSTOM_SETTINGS_ID);
+    if (it == pluginSettings.constEnd())
+        return {};
+    return it->toBool();
+}
+
+// Finds the project that a file is in like the IDE would for an open project: the closest
+// directory with a project file that has a .user or .shared file next to it.
+class ProjectSettings
+{
+public:
+    // Not set for a directory outside of projects.
+    std::optional<bool> overrideStyleFile(const FilePath &directory)
+    {
+        QMutexLocker locker(&m_mutex);
+        return overrideStyleFileLocked(directory);
+    }
+
+private:
+    std::optional<bool> overrideStyleFileLocked(const FilePath &directory)
+    {
+        const auto it = m_directories.constFind(directory);
+        if (it != m_directories.constEnd())
+            return *it;
+
+        std::optional<bool> result;
+        bool isProjectDirectory = false;
+        const QDir dir(directory.toString());
+        for (const QString &projectFile : dir.entryList(QDir::Files)) {
+            const FilePath userFile = directory / (projectFile + ".user");
+            const FilePath sharedFile = directory / (projectFile + ".shared");
+            if (!userFile.exists() && !sharedFile.exists())
+                continue;
+            isProjectDirectory = true;
+            if (const std::optional<bool> shared = overrideStyleFileSetting(sharedFile))
+                result = shared;
+            else
+                result = overrideStyleFileSetting(userFile);
+            // namedSettings() of a project without the setting.
+            if (!result)
+                result = false;
+            break;
+        }
+        if (!isProjectDirectory && !directory.parentDir().isEmpty()
+            && directory.parentDir() != directory) {
+            result = overrideStyleFileLocked(directory.parentDir());
+        }
+        m_directories.insert(directory, result);
+        return result;
+    }
+
+    QMutex m_mutex;
+    QHash<FilePath, std::optional<bool>> m_directories;
+};
+
+enum class Outcome { Unchanged, Formatted, WouldChange, Failed };
+
+struct FileResult
+{
+    Outcome outcome = Outcome::Unchanged;
+    QString error;
+};
+
+// getStyle() depends on the directory, which decides the .clang-format file, and on the
+// language guessed from the file name, which picks the section of that file. Files of the
+// same language next to each other share the style.
+class StyleCache
+{
+public:
+    StyleCache(const Options &options, ProjectSettings &projects)
+        : m_options(options)
+        , m_projects(projects)
+    {}
+
+    clang::format::FormatStyle styleForFile(const FilePath &filePath)
+    {
+        // resolveFormatStyle() gives getStyle() no code, so neither does the key.
+        const StyleKey key{filePath.parentDir(),
+                           int(clang::format::guessLanguage(filePath.path().toStdString(), {}))};
+        {
+            QMutexLocker locker(&m_mutex);
+            const auto it = m_styles.constFind(key);
+            if (it != m_styles.constEnd())
+                return *it;
+        }
+        const clang::format::FormatStyle style
+            = resolveFormatStyle(filePath,
+                                 overrideStyleFile(filePath.parentDir()),
+                                 m_options.codeStyleSettingsFile);
+        QMutexLocker locker(&m_mutex);
+        m_styles.insert(key, style);
+        return style;
+    }
+
+private:
+    using StyleKey = QPair<FilePath, int>; // directory and clang::format language kind
+
+    // Like formatStyleForFile() in the plugin: the setting of the project, if there is one.
+    bool overrideStyleFile(const FilePath &directory)
+    {
+        if (m_options.forceOverrideStyleFile)
+            return true;
+        if (m_options.projectOverrideStyleFile)
+            return *m_options.projectOverrideStyleFile;
+        return m_projects.overrideStyleFile(directory).value_or(m_options.globalOverrideStyleFile);
+    }
+
+    const Options &m_options;
+    ProjectSettings &m_projects;
+    QMutex m_mutex;
+    QHash<StyleKey, clang::format::FormatStyle> m_styles;
+};
+
+std::optional<QByteArray> formatted(std::string_view contents,
+                                    const Utf8Replacements &replacements)
+{
+    if (replacements.empty())
+        return {};
+    QByteArray result;
+    result.reserve(int(contents.size()));
+    int position = 0;
+    for (const Utf8Replacement &replacement : replacements) {
+        result.append(contents.data() + position, replacement.offset - position);
+        result.append(replacement.text.data(), int(replacement.text.size()));
+        position = replacement.offset + replacement.length;
+    }
+    result.append(contents.data() + position, int(contents.size()) - position);
+    if (std::string_view(result.constData(), size_t(result.size())) == contents)
+        return {};
+    return result;
+}
+
+FileResult processFile(const FilePath &filePath, const Options &options, StyleCache &styles)
+{
+    QFile file(filePath.toString());
+    if (!file.open(QIODevice::ReadOnly))
+        return {Outcome::Failed, file.errorString()};
+
+    // The file is mapped instead of read into a buffer, so the contents of the files that are
+    // formatted in parallel are only paged in. Empty files and files that cannot be mapped,
+    // e.g. on some network file systems, are read.
+    QByteArray readContents;
+    std::string_view contents;
+    if (uchar *mapped = file.size() > 0 ? file.map(0, file.size()) : nullptr) {
+        contents = std::string_view(reinterpret_cast<const char *>(mapped), size_t(file.size()));
+    } else {
+        readContents = file.readAll();
+        contents = std::string_view(readContents.constData(), size_t(readContents.size()));
+    }
+
+    const Utf8Replacements replacements = formatBuffer(contents,
+                                                       styles.styleForFile(filePath),
+                                                       filePath,
+                                                       {{0, int(contents.size())}});
+    const std::optional<QByteArray> result = formatted(contents, replacements);
+    // Unmapped before the file is replaced, which Windows does not allow for a mapped file.
+    file.close();
+    if (!result)
+        return {};
+    if (options.check)
+        return {Outcome::WouldChange, {}};
+
+    // Written next to the file and renamed, so that the file is never half written.
+    QSaveFile saveFile(filePath.toString());
+    if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(*result) != result->size()
+        || !saveFile.commit()) {
+        return {Outcome::Failed, saveFile.errorString()};
+    }
+    return {Outcome::Formatted, {}};
+}
+
+// The directory with QtCreator.ini and the qtcreator resource directory, "QtProject" below
+// the -settingspath of Qt Creator.
+QString defaultSettingsPath()
+{
+    const QSettings settings(QSettings::IniFormat,
+                             QSettings::UserScope,
+                             QLatin1String("QtProject"),
+                             QLatin1String("QtCreator"));
+    return QFileInfo(settings.fileName()).path();
+}
+
+bool globalOverrideStyleFile(const QString &settingsPath)
+{
+    QSettings settings(settingsPath + "/QtCreator.ini", QSettings::IniFormat);
+    settings.beginGroup(Constants::SETTINGS_ID);
+    return settings.value(Constants::USE_CUSTOM_SETTINGS_ID, false).toBool();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("clangformatcli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Formats files like the ClangFormat plugin of Qt Creator.");
+    parser.addHelpOption();
+    const QCommandLineOption checkOption("check",
+                                         "Report the files that would change, do not write.");
+    parser.addOption(checkOption);
+    const QCommandLineOption jobsOption({"j", "jobs"},
+                                        "Format <count> files in parallel.",
+                                        "count",
+                                        QString::number(QThread::idealThreadCount()));
+    parser.addOption(jobsOption);
+    const QCommandLineOption settingsPathOption("settings-path",
+                                                "The QtProject settings directory of Qt Creator.",
+                                                "directory",
+                                                defaultSettingsPath());
+    parser.addOption(settingsPathOption);
+    const QCommandLineOption codeStyleOption("code-style",
+                                             "The C++ code style whose ClangFormat settings "
+                                             "apply when there is no .clang-format file.",
+                                             "name",
+                                             "Qt [built-in]");
+    parser.addOption(codeStyleOption);
+    const QCommandLineOption overrideOption("override-style-file",
+                                            "Use the settings of the code style even if there "
+                                            "is a .clang-format file, for all files. Default: "
+                                            "the setting of the project of a file, or the "
+                                            "global setting.");
+    parser.addOption(overrideOption);
+    const QCommandLineOption projectSettingsOption("project-settings",
+                                                   "Take the override setting for all files "
+                                                   "from the .user or .shared file of a "
+                                                   "project, e.g. in a CI checkout.",
+                                                   "file");
+    parser.addOption(projectSettingsOption);
+    parser.addPositionalArgument("files", "The files to format.", "<file>...");
+    parser.process(app);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty())
+        parser.showHelp(1);
+
+    const QString settingsPath = parser.value(settingsPathOption);
+    Options options;
+    options.check = parser.isSet(checkOption);
+    options.forceOverrideStyleFile = parser.isSet(overrideOption);
+    if (parser.isSet(projectSettingsOption)) {
+        const FilePath projectSettingsFile = FilePath::fromUserInput(
+            parser.value(projectSettingsOption));
+        if (!projectSettingsFile.exists()) {
+            std::fprintf(stderr,
+                         "%s does not exist.\n",
+                         qPrintable(projectSettingsFile.toUserOutput()));
+            return 2;
+        }
+        options.projectOverrideStyleFile = overrideStyleFileSetting(projectSettingsFile)
+                                               .value_or(false);
+    }
+    options.globalOverrideStyleFile = globalOverrideStyleFile(settingsPath);
+    options.codeStyleSettingsFile
+        = codeStyleSettingsFile(FilePath::fromUserInput(settingsPath) / "qtcreator",
+                                parser.value(codeStyleOption));
+
+    ProjectSettings projects;
+    StyleCache styles(options, projects);
+    std::vector<FileResult> results(size_t(files.size()));
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, parser.value(jobsOption).toInt()));
+    for (int i = 0; i < files.size(); ++i) {
+        const FilePath filePath = FilePath::fromUserInput(files.at(i));
+        pool.start([&, filePath, i] {
+            results[size_t(i)] = processFile(filePath, options, styles);
+        });
+    }
+    pool.waitForDone();
+
+    // Reported in the order of the arguments, independent of the scheduling.
+    bool wouldChange = false;
+    bool failed = false;
+    for (int i = 0; i < files.size(); ++i) {
+        const FileResult &result = results.at(size_t(i));
+        switch (result.outcome) {
+        case Outcome::Unchanged:
+            break;
+        case Outcome::Formatted:
+            std::printf("Formatted %s\n", qPrintable(files.at(i)));
+            break;
+        case Outcome::WouldChange:
+            std::printf("%s\n", qPrintable(files.at(i)));
+            wouldChange = true;
+            break;
+        case Outcome::Failed:
+            std::fprintf(stderr, "%s: %s\n", qPrintable(files.at(i)), qPrintable(result.error));
+            failed = true;
+            break;
+        }
+    }
+
+    if (failed)
+        return 2;
+    return wouldChange ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+// libFuzzer target that searches for inputs that make the indentation of the ClangFormat
+// plugin slow. It runs the steps of ClangFormatBaseIndenter::replacements() that do not need
+// an editor: the dummy text for empty lines and lines starting with ')' or '}', the
+// reformat() call, and the second try when the first one returned nothing.
+//
+// The duration of each input is fed back to libFuzzer as coverage, so that inputs reaching
+// a slower duration bucket are kept in the corpus and mutated further. Inputs that take
+// longer than the budget are saved like the slow requests of the plugin, so that they can be
+// replayed with clangformatreplay and kept as regression cases.
+//
+//   clangformatfuzzer -dict=clangformatfuzzer.dict -max_len=4096 corpus/
+//
+// Environment variables:
+//   CLANGFORMATFUZZER_BUDGET_MS    budget per input in milliseconds, default 50
+//   CLANGFORMATFUZZER_REGRESSIONS  directory for the slow inputs, default "slow-inputs"
+//   CLANGFORMATFUZZER_STYLE        .clang-format file to use, default the LLVM style
+//
+// The first two bytes of an input select the request, the rest is the document:
+//   byte 0: bit 0 IndentAndBefore instead of OnlyIndent, bits 1-7 number of lines
+//   byte 1: first line to indent, modulo the line count of the document
+
+#include "clangformatformatter.h"
+#include "clangformatindentationbuffer.h"
+#include "clangformatreprobundle.h"
+
+#include <utils/textutils.h>
+
+#include <clang/Format/Format.h>
+
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QTextDocument>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ClangFormat;
+using namespace Utils;
+
+namespace {
+
+#ifdef __linux__
+// Read by libFuzzer in addition to the coverage counters.
+__attribute__((used, section("__libfuzzer_extra_counters"))) uint8_t durationCounters[32];
+#endif
+
+void recordDuration(qint64 ns)
+{
+#ifdef __linux__
+    // One counter per power of two of microseconds, a slower bucket is new coverage.
+    int bucket = 0;
+    for (qint64 us = ns / 1000; us > 0 && bucket < int(sizeof(durationCounters)) - 1; us >>= 1)
+        ++bucket;
+    durationCounters[bucket] = 1;
+#else
+    Q_UNUSED(ns)
+#endif
+}
+
+struct Options
+{
+    qint64 budgetMs = 50;
+    FilePath regressions = FilePath::fromString("slow-inputs");
+    clang::format::FormatStyle style = clang::format::getLLVMStyle();
+    std::string styleText;
+};
+
+Options &options()
+{
+    static Options options;
+    return options;
+}
+
+Options readOptions()
+{
+    Options result;
+    if (qEnvironmentVariableIsSet("CLANGFORMATFUZZER_BUDGET_MS"))
+        result.budgetMs = qEnvironmentVariableIntValue("CLANGFORMATFUZZER_BUDGET_MS");
+    if (qEnvironmentVariableIsSet("CLANGFORMATFUZZER_REGRESSIONS"))
+        result.regressions = FilePath::fromUserInput(
+            qEnvironmentVariable("CLANGFORMATFUZZER_REGRESSIONS"));
+
+    result.style.Language = clang::format::FormatStyle::LK_Cpp;
+    if (qEnvironmentVariableIsSet("CLANGFORMATFUZZER_STYLE")) {
+        const FilePath styleFile = FilePath::fromUserInput(
+            qEnvironmentVariable("CLANGFORMATFUZZER_STYLE"));
+        const expected_str<QByteArray> contents = styleFile.fileContents();
+        if (!contents) {
+            std::fprintf(stderr, "%s\n", qPrintable(contents.error()));
+            std::exit(1);
+        }
+        const std::error_code error = clang::format::parseConfiguration(contents->toStdString(),
+                                                                        &result.style);
+        if (error) {
+            std::fprintf(stderr, "%s: invalid style: %s\n",
+                         qPrintable(styleFile.toUserOutput()), error.message().c_str());
+            std::exit(1);
+        }
+    }
+    return result;
+}
+
+struct Request
+{
+    ReplacementsToKeep replacementsToKeep = ReplacementsToKeep::OnlyIndent;
+    int firstLine = 0;
+    int lineCount = 1;
+    QByteArray document;
+};
+
+Request decode(const uint8_t *data, size_t size)
+{
+    Request request;
+    if (size < 2)
+        return request;
+    request.replacementsToKeep = (data[0] & 1) ? ReplacementsToKeep::IndentAndBefore
+                                               : ReplacementsToKeep::OnlyIndent;
+    request.lineCount = 1 + (data[0] >> 1);
+    request.firstLine = data[1];
+    request.document = QByteArray(reinterpret_cast<const char *>(data) + 2, int(size - 2));
+    return request;
+}
+
+struct Result
+{
+    ReproBundle bundle;
+    std::size_t replacementCount = 0;
+};
+
+// Like ClangFormatBaseIndenter::replacements() for an editor without a typed character.
+Result indent(const QTextDocument &doc, const Request &request, bool secondTry)
+{
+    const QTextBlock startBlock = doc.findBlockByNumber(request.firstLine % doc.blockCount());
+    QTextBlock endBlock = doc.findBlockByNumber(startBlock.blockNumber() + request.lineCount - 1);
+    if (!endBlock.isValid())
+        endBlock = doc.lastBlock();
+
+    Result result;
+    QByteArray buffer = Internal::documentBuffer(&doc);
+    int utf8Offset = Text::utf8NthLineOffset(&doc, buffer, startBlock.blockNumber() + 1);
+    if (utf8Offset < 0)
+        return result;
+    int utf8Length = 0;
+    for (QTextBlock block = startBlock; block.isValid(); block = block.next()) {
+        utf8Length += block.text().toUtf8().size() + (block == endBlock ? 0 : 1);
+        if (block == endBlock)
+            break;
+    }
+    if (request.replacementsToKeep == ReplacementsToKeep::OnlyIndent)
+        utf8Length += Internal::addIndentationDummyText(buffer, startBlock, endBlock, secondTry);
+
+    const Utf8Replacements replacements
+        = indentBuffer(std::string_view(buffer.constData(), size_t(buffer.size())),
+                       options().style,
+                       FilePath::fromString("fuzzer.cpp"),
+                       {utf8Offset, utf8Length},
+                       request.replacementsToKeep);
+
+    result.replacementCount = replacements.size();
+    result.bundle.buffer = buffer;
+    result.bundle.style = clang::format::configurationAsText(
+        indentationStyle(options().style, request.replacementsToKeep));
+    result.bundle.ranges = {clang::tooling::Range(unsigned(utf8Offset), unsigned(utf8Length))};
+    result.bundle.fileName = "fuzzer.cpp";
+    result.bundle.replacementsToKeep = request.replacementsToKeep == ReplacementsToKeep::OnlyIndent
+                                           ? QString("OnlyIndent")
+                                           : QString("IndentAndBefore");
+    result.bundle.secondTry = secondTry;
+    return result;
+}
+
+void saveRegression(const ReproBundle &bundle, const uint8_t *data, size_t size)
+{
+    const expected_str<FilePath> directory = writeReproBundle(bundle, options().regressions);
+    if (!directory) {
+        std::fprintf(stderr, "Cannot save slow input: %s\n", qPrintable(directory.error()));
+        return;
+    }
+    // The input itself, to run the fuzzer on it again or to add it to a corpus.
+    (*directory / "fuzzer-input").writeFileContents(
+        QByteArray(reinterpret_cast<const char *>(data), int(size)));
+    std::fprintf(stderr, "Saved slow input (%lld ms) to %s\n",
+                 static_cast<long long>(bundle.totalMs),
+                 qPrintable(directory->toUserOutput()));
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+    // QTextDocument needs fonts, but no display.
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    static int argc = 1;
+    static char name[] = "clangformatfuzzer";
+    static char *argv[] = {name, nullptr};
+    static QGuiApplication app(argc, argv);
+    options() = readOptions();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const Request request = decode(data, size);
+    if (request.document.isEmpty())
+        return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    // The document is converted to UTF-16 by the editor before any request.
+    const QTextDocument doc(QString::fromUtf8(request.document));
+    Result result = indent(doc, request, false);
+    if (result.replacementCount == 0
+        && request.replacementsToKeep == ReplacementsToKeep::OnlyIndent) {
+        result = indent(doc, request, true);
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    recordDuration(elapsedNs);
+
+    if (options().budgetMs > 0 && elapsedNs / 1000000 >= options().budgetMs) {
+        result.bundle.totalMs = elapsedNs / 1000000;
+        saveRegression(result.bundle, data, size);
+    }
+    return 0;
+}
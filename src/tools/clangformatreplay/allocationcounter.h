@@ -0,0 +1,35 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#pragma once
+
+#include <cstddef>
+
+// Counts the calls to the global operator new of the process. The operators are replaced in
+// allocationcounter.cpp, which also covers the shared LLVM libraries on ELF platforms. On
+// Windows, allocations inside other DLLs are not seen.
+
+struct Allocations
+{
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+};
+
+Allocations allocationsSoFar();
+
+class AllocationScope
+{
+public:
+    AllocationScope()
+        : m_start(allocationsSoFar())
+    {}
+
+    Allocations allocations() const
+    {
+        const Allocations now = allocationsSoFar();
+        return {now.count - m_start.count, now.bytes - m_start.bytes};
+    }
+
+private:
+    Allocations m_start;
+};
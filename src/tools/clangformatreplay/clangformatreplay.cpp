@@ -0,0 +1,233 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+// Replays requests saved by the ClangFormat plugin when they exceeded the
+// "Save requests slower than" threshold, so that they can be profiled offline.
+// With --allocation-budget, it fails when a replayed request allocates more than that per
+// KiB of the buffer. The per phase budgets on checked-in documents are in
+// tests/auto/clangformat, this is for looking at the allocations of real requests.
+
+#include "allocationcounter.h"
+#include "clangformatformatter.h"
+#include "clangformatindentationbuffer.h"
+#include "clangformatmemory.h"
+#include "clangformatreprobundle.h"
+
+#include <clang/Format/Format.h>
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QTextDocument>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace ClangFormat;
+using namespace Utils;
+
+namespace {
+
+// The steps of ClangFormatBaseIndenter for one request, with the functions of the plugin.
+enum Phase { BufferPhase, ClangFormatPhase, Utf16Phase, PhaseCount };
+
+const char *const phaseNames[PhaseCount] = {"UTF-8 buffer", "clang-format", "UTF-16 conversion"};
+
+struct ReplayResult
+{
+    std::size_t replacementCount = 0;
+    Allocations allocations[PhaseCount];
+};
+
+ReplacementsToKeep replacementsToKeep(const QString &name)
+{
+    if (name == "IndentAndBefore")
+        return ReplacementsToKeep::IndentAndBefore;
+    if (name == "All")
+        return ReplacementsToKeep::All;
+    return ReplacementsToKeep::OnlyIndent;
+}
+
+// The document is created from the saved buffer, so it contains the dummy text of the
+// request. The conversion back to the document keeps the replacements in it, which the
+// editor would drop, and does the same work otherwise.
+ReplayResult replay(const ReproBundle &bundle,
+                    const QTextDocument &document,
+                    const clang::format::FormatStyle &style)
+{
+    ReplayResult result;
+
+    AllocationScope bufferScope;
+    const QByteArray buffer = Internal::documentBuffer(&document);
+    result.allocations[BufferPhase] = bufferScope.allocations();
+
+    AllocationScope clangFormatScope;
+    const std::string_view code(buffer.constData(), size_t(buffer.size()));
+    const FilePath filePath = FilePath::fromString(bundle.fileName);
+    const ReplacementsToKeep mode = replacementsToKeep(bundle.replacementsToKeep);
+    Utf8Replacements replacements;
+    if (mode == ReplacementsToKeep::All) {
+        std::vector<Utf8Range> ranges;
+        for (const clang::tooling::Range &range : bundle.ranges)
+            ranges.push_back({int(range.getOffset()), int(range.getLength())});
+        replacements = formatBuffer(code, style, filePath, ranges);
+    } else if (!bundle.ranges.empty()) {
+        // The saved range already starts where formatting before the lines starts.
+        const clang::tooling::Range &range = bundle.ranges.front();
+        replacements = indentBuffer(code,
+                                    style,
+                                    filePath,
+                                    {int(range.getOffset()), int(range.getLength())},
+                                    mode);
+    }
+    result.allocations[ClangFormatPhase] = clangFormatScope.allocations();
+
+    AllocationScope utf16Scope;
+    const Text::Replacements utf16Replacements = Internal::utf16Replacements(&document,
+                                                                             buffer,
+                                                                             replacements);
+    result.allocations[Utf16Phase] = utf16Scope.allocations();
+
+    result.replacementCount = utf16Replacements.size();
+    return result;
+}
+
+Allocations total(const ReplayResult &result)
+{
+    Allocations sum;
+    for (const Allocations &allocations : result.allocations) {
+        sum.count += allocations.count;
+        sum.bytes += allocations.bytes;
+    }
+    return sum;
+}
+
+// Returns false if the bundle cannot be read or exceeds the allocation budget.
+bool replayBundle(const FilePath &bundleDirectory,
+                  int repeat,
+                  bool reportAllocations,
+                  std::size_t allocationsPerKiB)
+{
+    const expected_str<ReproBundle> bundle = readReproBundle(bundleDirectory);
+    if (!bundle) {
+        std::fprintf(stderr, "%s\n", qPrintable(bundle.error()));
+        return false;
+    }
+
+    clang::format::FormatStyle style;
+    style.Language = clang::format::FormatStyle::LK_Cpp;
+    const std::error_code error = clang::format::parseConfiguration(bundle->style, &style);
+    if (error) {
+        std::fprintf(stderr, "%s: invalid style: %s\n",
+                     qPrintable(bundleDirectory.toUserOutput()), error.message().c_str());
+        return false;
+    }
+
+    const QTextDocument document(QString::fromUtf8(bundle->buffer));
+    std::vector<qint64> timesMs;
+    ReplayResult result;
+    for (int i = 0; i < repeat; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        result = replay(*bundle, document, style);
+        timesMs.push_back(timer.elapsed());
+    }
+    std::sort(timesMs.begin(), timesMs.end());
+
+    std::printf("%s\n"
+                "  file: %s, mode: %s, typed: \"%s\", second try: %s\n"
+                "  buffer: %lld bytes, ranges: %zu, replacements: %zu\n"
+                "  recorded: %lld ms total, %lld ms reformat\n"
+                "  replayed: %lld ms min, %lld ms median, %lld ms max (%d runs)\n",
+                qPrintable(bundleDirectory.toUserOutput()),
+                qPrintable(bundle->fileName),
+                qPrintable(bundle->replacementsToKeep),
+                qPrintable(bundle->typedChar),
+                bundle->secondTry ? "yes" : "no",
+                static_cast<long long>(bundle->buffer.size()),
+                bundle->ranges.size(),
+                result.replacementCount,
+                static_cast<long long>(bundle->totalMs),
+                static_cast<long long>(bundle->reformatMs),
+                static_cast<long long>(timesMs.front()),
+                static_cast<long long>(timesMs.at(timesMs.size() / 2)),
+                static_cast<long long>(timesMs.back()),
+                repeat);
+
+    // Includes what clang-format keeps around after the runs.
+    const Memory::ProcessMemory memory = Memory::processMemory();
+    std::printf("  process memory: %lld bytes resident, %lld bytes private\n",
+                static_cast<long long>(memory.residentBytes),
+                static_cast<long long>(memory.privateBytes));
+
+    // The last run is reported, earlier runs may have filled caches of clang-format.
+    const Allocations sum = total(result);
+    if (reportAllocations) {
+        for (int phase = 0; phase < PhaseCount; ++phase) {
+            std::printf("  allocations, %s: %zu (%zu bytes)\n",
+                        phaseNames[phase],
+                        result.allocations[phase].count,
+                        result.allocations[phase].bytes);
+        }
+        std::printf("  allocations, total: %zu (%zu bytes)\n", sum.count, sum.bytes);
+    }
+
+    const std::size_t kiB = std::max<std::size_t>(1, (bundle->buffer.size() + 1023) / 1024);
+    const std::size_t allocationBudget = allocationsPerKiB * kiB;
+    if (allocationsPerKiB > 0 && sum.count > allocationBudget) {
+        std::fprintf(stderr, "%s: %zu allocations exceed the budget of %zu (%zu per KiB)\n",
+                     qPrintable(bundleDirectory.toUserOutput()), sum.count, allocationBudget,
+                     allocationsPerKiB);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // QTextDocument needs fonts, but no display.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName("clangformatreplay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays slow ClangFormat requests saved by Qt Creator.");
+    parser.addHelpOption();
+    const QCommandLineOption repeatOption({"r", "repeat"},
+                                          "Replay each request <count> times.",
+                                          "count",
+                                          "1");
+    parser.addOption(repeatOption);
+    const QCommandLineOption allocationsOption({"a", "allocations"},
+                                               "Report the allocations of each phase.");
+    parser.addOption(allocationsOption);
+    const QCommandLineOption budgetOption("allocation-budget",
+                                          "Fail if a request allocates more than <count> times "
+                                          "per KiB of its buffer. 0 disables the check.",
+                                          "count",
+                                          "0");
+    parser.addOption(budgetOption);
+    parser.addPositionalArgument("bundles", "Directories of the saved requests.", "<bundle>...");
+    parser.process(app);
+
+    const QStringList bundles = parser.positionalArguments();
+    if (bundles.isEmpty())
+        parser.showHelp(1);
+
+    const int repeat = std::max(1, parser.value(repeatOption).toInt());
+    const std::size_t allocationsPerKiB = parser.value(budgetOption).toULongLong();
+    const bool reportAllocations = parser.isSet(allocationsOption);
+    bool success = true;
+    for (const QString &bundle : bundles) {
+        success = replayBundle(FilePath::fromUserInput(bundle),
+                               repeat,
+                               reportAllocations,
+                               allocationsPerKiB)
+                  && success;
+    }
+
+    return success ? 0 : 1;
+}
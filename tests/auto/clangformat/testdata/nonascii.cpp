@@ -0,0 +1,25 @@
+// Größenangaben für die Übersicht, 日本語のコメント, and ASCII after them.
+#include <string>
+
+namespace Fixture {
+
+struct Measurement
+{
+    std::string label = "Länge";
+    double value = 0;
+};
+
+int weighted(const Measurement &measurement, int count)
+{
+    const std::string unit = "µm"; // ± 0.5
+    int sum = 0;
+    for (int i = 0; i < count; ++i) {
+        if (measurement.value > i)
+            sum += i * 2;
+        else
+            sum -= i;
+    }
+    return sum + int(unit.size()) + int(measurement.label.size());
+}
+
+} // namespace Fixture
@@ -0,0 +1,295 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+#include "allocationcounter.h"
+#include "clangformatformatter.h"
+#include "clangformatindentationbuffer.h"
+#include "clangformattextscanner.h"
+
+#include <utils/textutils.h>
+
+#include <clang/Format/Format.h>
+
+#include <QFile>
+#include <QGuiApplication>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QtTest>
+
+using namespace ClangFormat;
+using namespace Utils;
+
+// The budgets are counted from the code of each phase, so that one more allocation per block,
+// per line or per character of the document fails.
+
+// The UTF-16 text of the document and its UTF-8 encoding.
+const std::size_t documentBufferAllocations = 4;
+// The text of the document, once after a change, not per block or per character.
+const std::size_t scannerAllocations = 1;
+// The blocks around the empty line, the dummy text and the buffer growing twice.
+const std::size_t dummyTextAllocations = 16;
+// The text of the block, the line in the buffer, the column and the length, and the new text.
+const std::size_t utf16AllocationsPerReplacement = 8;
+// On top of what clang::format::reformat() itself allocates for the request: the style, the
+// file name, the ranges and the filtered replacements.
+const std::size_t indentBufferAllocations = 32;
+const std::size_t indentBufferAllocationsPerReplacement = 2;
+
+static QString repositoryFile(const QString &relativePath)
+{
+    return QString(SRCDIR "/../../../") + relativePath;
+}
+
+static QByteArray fileContents(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+static clang::format::FormatStyle testStyle()
+{
+    clang::format::FormatStyle style = clang::format::getLLVMStyle();
+    style.Language = clang::format::FormatStyle::LK_Cpp;
+    return style;
+}
+
+// The first indented statement in the second half of the document, followed by a line with
+// text, like the line that Enter is pressed on.
+static QTextBlock statementBlock(const QTextDocument &document)
+{
+    for (QTextBlock block = document.findBlockByNumber(document.blockCount() / 2);
+         block.isValid() && block.next().isValid();
+         block = block.next()) {
+        const QString text = block.text();
+        if (text.startsWith("    ") && text.trimmed().endsWith(';')
+            && !block.next().text().trimmed().isEmpty()) {
+            return block;
+        }
+    }
+    return {};
+}
+
+static Utf8Range lineRange(const QTextDocument &document,
+                           const QByteArray &buffer,
+                           const QTextBlock &block)
+{
+    return {Text::utf8NthLineOffset(&document, buffer, block.blockNumber() + 1),
+            int(block.text().toUtf8().size())};
+}
+
+static std::string_view view(const QByteArray &buffer)
+{
+    return std::string_view(buffer.constData(), size_t(buffer.size()));
+}
+
+class tst_ClangFormatAllocations : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void documentBuffer_data() { addFixtures(); }
+    void documentBuffer();
+    void scanner_data() { addFixtures(); }
+    void scanner();
+    void indentationDummyText_data() { addFixtures(); }
+    void indentationDummyText();
+    void indentBuffer_data() { addFixtures(); }
+    void indentBuffer();
+    void utf16Replacements_data() { addFixtures(); }
+    void utf16Replacements();
+
+private:
+    void addFixtures();
+};
+
+// Representative documents of the repository and one with multi-byte characters, which takes
+// the slow paths of the UTF-8 offsets.
+void tst_ClangFormatAllocations::addFixtures()
+{
+    QTest::addColumn<QString>("filePath");
+
+    QTest::newRow("indenter source")
+        << repositoryFile("src/plugins/clangformat/clangformatbaseindenter.cpp");
+    QTest::newRow("template header") << repositoryFile("src/libs/sqlite/sqlitebasestatement.h");
+    QTest::newRow("non-ASCII") << QString(SRCDIR "/testdata/nonascii.cpp");
+}
+
+void tst_ClangFormatAllocations::documentBuffer()
+{
+    QFETCH(QString, filePath);
+    const QByteArray contents = fileContents(filePath);
+    QVERIFY(!contents.isEmpty());
+    const QTextDocument document(QString::fromUtf8(contents));
+    // The first scan of a document registers it.
+    Internal::documentText(&document);
+
+    const AllocationScope scope;
+    const QByteArray buffer = Internal::documentBuffer(&document);
+    const Allocations allocations = scope.allocations();
+
+    QCOMPARE(buffer, contents);
+    QVERIFY2(allocations.count <= documentBufferAllocations,
+             qPrintable(QString::number(allocations.count)));
+    // UTF-16 and the worst case of the UTF-8 encoder.
+    QVERIFY(allocations.bytes <= std::size_t(document.characterCount()) * 5 + 1024);
+}
+
+void tst_ClangFormatAllocations::scanner()
+{
+    QFETCH(QString, filePath);
+    QTextDocument document(QString::fromUtf8(fileContents(filePath)));
+    const QTextBlock statement = statementBlock(document);
+    QVERIFY(statement.isValid());
+    Internal::documentText(&document);
+
+    // A keystroke, the scanners have to take the text again.
+    QTextCursor cursor(statement);
+    cursor.movePosition(QTextCursor::EndOfBlock);
+    cursor.insertText(" ");
+
+    const AllocationScope scope;
+    int blankBlocks = 0;
+    int statementBlocks = 0;
+    for (QTextBlock block = document.firstBlock(); block.isValid(); block = block.next()) {
+        const Internal::BlockText text(block);
+        if (text.isBlank())
+            ++blankBlocks;
+        else if (text.trimmed().endsWith(';') && text.firstNonSpace() > 0)
+            ++statementBlocks;
+    }
+    int characters = 0;
+    Internal::DocumentScanner scanner(&document, document.characterCount() - 1);
+    while (scanner.previous()) {
+        if (!scanner.character().isSpace())
+            ++characters;
+    }
+    const Allocations allocations = scope.allocations();
+
+    QVERIFY(blankBlocks > 0);
+    QVERIFY(statementBlocks > 0);
+    QVERIFY(characters > 0);
+    QCOMPARE(Internal::documentText(&document).toString(), document.toPlainText());
+    QVERIFY2(allocations.count <= scannerAllocations,
+             qPrintable(QString::number(allocations.count)));
+    QVERIFY(allocations.bytes <= std::size_t(document.characterCount()) * 2 + 1024);
+}
+
+void tst_ClangFormatAllocations::indentationDummyText()
+{
+    QFETCH(QString, filePath);
+    QTextDocument document(QString::fromUtf8(fileContents(filePath)));
+    const QTextBlock statement = statementBlock(document);
+    QVERIFY(statement.isValid());
+
+    // Enter after the statement.
+    QTextCursor cursor(statement);
+    cursor.movePosition(QTextCursor::EndOfBlock);
+    cursor.insertBlock();
+    const QTextBlock emptyBlock = statement.next();
+    QVERIFY(emptyBlock.text().isEmpty());
+
+    QByteArray buffer = Internal::documentBuffer(&document);
+    const int bufferSize = buffer.size();
+
+    const AllocationScope scope;
+    const int inserted = Internal::addIndentationDummyText(buffer, emptyBlock, emptyBlock, false);
+    const Allocations allocations = scope.allocations();
+
+    QCOMPARE(buffer.size(), bufferSize + inserted);
+    QVERIFY(inserted > 0);
+    QVERIFY2(allocations.count <= dummyTextAllocations,
+             qPrintable(QString::number(allocations.count)));
+    QVERIFY(allocations.bytes <= std::size_t(bufferSize) * 2 + 4096);
+}
+
+void tst_ClangFormatAllocations::indentBuffer()
+{
+    QFETCH(QString, filePath);
+    QTextDocument document(QString::fromUtf8(fileContents(filePath)));
+    const QTextBlock statement = statementBlock(document);
+    QVERIFY(statement.isValid());
+
+    // A statement that lost its indentation, so that there is something to replace.
+    QTextCursor cursor(statement);
+    cursor.movePosition(QTextCursor::NextWord, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+
+    const QByteArray buffer = Internal::documentBuffer(&document);
+    const Utf8Range lines = lineRange(document, buffer, statement);
+    const clang::format::FormatStyle style = testStyle();
+    const FilePath fileName = FilePath::fromString(filePath);
+
+    const auto indent = [&] {
+        return ClangFormat::indentBuffer(view(buffer),
+                                         style,
+                                         fileName,
+                                         lines,
+                                         ReplacementsToKeep::OnlyIndent);
+    };
+    const auto reformat = [&] {
+        const clang::format::FormatStyle indentation
+            = indentationStyle(style, ReplacementsToKeep::OnlyIndent);
+        return clang::format::reformat(indentation,
+                                       llvm::StringRef(buffer.constData(), buffer.size()),
+                                       {clang::tooling::Range(unsigned(lines.offset),
+                                                              unsigned(lines.length))},
+                                       fileName.toString().toStdString());
+    };
+    // clang-format fills some caches on the first run.
+    indent();
+    reformat();
+
+    const AllocationScope reformatScope;
+    reformat();
+    const Allocations reformatAllocations = reformatScope.allocations();
+
+    const AllocationScope indentScope;
+    const Utf8Replacements replacements = indent();
+    const Allocations allocations = indentScope.allocations();
+
+    QVERIFY(!replacements.empty());
+    const std::size_t budget = reformatAllocations.count + indentBufferAllocations
+                               + indentBufferAllocationsPerReplacement * replacements.size();
+    QVERIFY2(allocations.count <= budget,
+             qPrintable(QString("%1 > %2").arg(allocations.count).arg(budget)));
+}
+
+void tst_ClangFormatAllocations::utf16Replacements()
+{
+    QFETCH(QString, filePath);
+    const QTextDocument document(QString::fromUtf8(fileContents(filePath)));
+    const QByteArray buffer = Internal::documentBuffer(&document);
+
+    // The LLVM style changes most lines of the Qt style, that is many replacements.
+    const Utf8Replacements replacements = formatBuffer(view(buffer),
+                                                       testStyle(),
+                                                       FilePath::fromString(filePath),
+                                                       {{0, int(buffer.size())}});
+    QVERIFY(!replacements.empty());
+
+    const AllocationScope scope;
+    const Text::Replacements converted = Internal::utf16Replacements(&document,
+                                                                     buffer,
+                                                                     replacements);
+    const Allocations allocations = scope.allocations();
+
+    QCOMPARE(converted.size(), replacements.size());
+    const std::size_t budget = 1 + utf16AllocationsPerReplacement * replacements.size();
+    QVERIFY2(allocations.count <= budget,
+             qPrintable(QString("%1 > %2").arg(allocations.count).arg(budget)));
+}
+
+int main(int argc, char *argv[])
+{
+    // QTextDocument needs fonts, but no display.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    tst_ClangFormatAllocations test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_clangformatallocations.moc"
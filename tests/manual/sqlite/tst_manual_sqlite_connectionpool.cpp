@@ -0,0 +1,231 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+// Compares the read throughput of threads that share one connection with that of threads
+// reading through a ConnectionPool on a file database, and measures the reads of the pool
+// while another thread keeps writing.
+//
+//   tst_manual_sqlite_connectionpool reads readsWhileWriting
+
+#include <sqlitebasestatement.h>
+#include <sqlitedatabase.h>
+#include <sqlitereadstatement.h>
+#include <sqlitewritestatement.h>
+
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int rowCount = 100000;
+const int readsPerThread = 20000;
+
+const char selectName[] = "SELECT name FROM rows WHERE id=?";
+const char insertRow[] = "INSERT INTO rows(id, name) VALUES(?1, ?2)";
+
+using Pool = Sqlite::ConnectionPool<Sqlite::Database>;
+
+struct ThreadResult
+{
+    int reads = 0;
+    qint64 slowestReadNs = 0;
+};
+
+// Runs read in threadCount threads and returns what they did.
+template<typename Read>
+std::vector<ThreadResult> runReaders(int threadCount, const Read &read)
+{
+    std::vector<ThreadResult> results(std::size_t(threadCount));
+    std::vector<std::thread> threads;
+    for (int index = 0; index < threadCount; ++index) {
+        threads.emplace_back([&, index] {
+            ThreadResult &result = results[std::size_t(index)];
+            QElapsedTimer timer;
+            for (int i = 0; i < readsPerThread; ++i) {
+                timer.start();
+                const long long id = (i * 7919ll + index) % rowCount;
+                if (!read(id).isEmpty())
+                    ++result.reads;
+                result.slowestReadNs = std::max(result.slowestReadNs, timer.nsecsElapsed());
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    return results;
+}
+
+void report(const std::vector<ThreadResult> &results, qint64 elapsedMs)
+{
+    int reads = 0;
+    qint64 slowestReadNs = 0;
+    for (const ThreadResult &result : results) {
+        reads += result.reads;
+        slowestReadNs = std::max(slowestReadNs, result.slowestReadNs);
+    }
+    qInfo("%zu threads: %d reads in %lld ms, %.0f reads per second, slowest read %.2f ms",
+          results.size(),
+          reads,
+          static_cast<long long>(elapsedMs),
+          reads * 1000.0 / double(std::max<qint64>(elapsedMs, 1)),
+          slowestReadNs / 1e6);
+}
+
+} // namespace
+
+class tst_ConnectionPool : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void reads_data();
+    void reads();
+    void readsWhileWriting_data();
+    void readsWhileWriting();
+
+private:
+    void addThreadCounts();
+    std::unique_ptr<Pool> createPool();
+
+    QTemporaryDir m_directory;
+    std::unique_ptr<Sqlite::Database> m_database;
+};
+
+void tst_ConnectionPool::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    m_database = std::make_unique<Sqlite::Database>(
+        Utils::PathString{m_directory.filePath("connectionpool.db")}, Sqlite::JournalMode::Wal);
+    {
+        std::lock_guard lock{*m_database};
+        m_database->execute("CREATE TABLE rows(id INTEGER PRIMARY KEY, name TEXT)");
+    }
+
+    std::vector<long long> ids(rowCount);
+    std::iota(ids.begin(), ids.end(), 0);
+    Sqlite::WriteStatement<2> insert{insertRow, *m_database};
+    insert.writeBatch(ids, [](long long id) {
+        return std::make_tuple(id, Utils::SmallString::number(id) + "/file.cpp");
+    });
+}
+
+void tst_ConnectionPool::cleanupTestCase()
+{
+    m_database.reset();
+}
+
+std::unique_ptr<Pool> tst_ConnectionPool::createPool()
+{
+    const Utils::PathString filePath{m_directory.filePath("connectionpool.db")};
+    return std::make_unique<Pool>(*m_database, [filePath] {
+        return std::make_unique<Sqlite::Database>(filePath, Sqlite::JournalMode::Wal);
+    });
+}
+
+void tst_ConnectionPool::addThreadCounts()
+{
+    QTest::addColumn<int>("threadCount");
+    for (int threadCount : {1, 2, 4, 8})
+        QTest::newRow(qPrintable(QString("%1 threads").arg(threadCount))) << threadCount;
+}
+
+void tst_ConnectionPool::reads_data()
+{
+    addThreadCounts();
+}
+
+void tst_ConnectionPool::reads()
+{
+    QFETCH(int, threadCount);
+
+    // One connection, each thread with its statement.
+    {
+        QElapsedTimer timer;
+        timer.start();
+        const auto results = runReaders(threadCount, [&](long long id) {
+            std::lock_guard lock{*m_database};
+            thread_local Sqlite::ReadStatement<1, 1> statement{selectName, *m_database};
+            return statement.value<Utils::SmallString>(id);
+        });
+        qInfo("One connection:");
+        report(results, timer.elapsed());
+    }
+
+    const std::unique_ptr<Pool> pool = createPool();
+    QElapsedTimer timer;
+    timer.start();
+    const auto results = runReaders(threadCount, [&](long long id) {
+        return pool->withStatement<1, 1>(selectName, [&](auto &statement) {
+            return statement.template value<Utils::SmallString>(id);
+        });
+    });
+    qInfo("Connection pool:");
+    report(results, timer.elapsed());
+    QCOMPARE(pool->readerCount(), std::size_t(0)); // the threads ended
+}
+
+void tst_ConnectionPool::readsWhileWriting_data()
+{
+    addThreadCounts();
+}
+
+void tst_ConnectionPool::readsWhileWriting()
+{
+    QFETCH(int, threadCount);
+    const std::unique_ptr<Pool> pool = createPool();
+
+    // Long write transactions of 1000 rows each, until the readers are done.
+    std::atomic<bool> readersDone{false};
+    std::atomic<int> writtenRows{0};
+    std::thread writer([&] {
+        long long nextId = rowCount;
+        while (!readersDone) {
+            pool->withWriter([&] {
+                pool->withStatement<0>("BEGIN IMMEDIATE", [](auto &statement) {
+                    statement.execute();
+                });
+                for (int row = 0; row < 1000; ++row, ++nextId) {
+                    pool->withStatement<0, 2>(insertRow, [&](auto &statement) {
+                        statement.write(nextId, Utils::SmallStringView{"written"});
+                    });
+                }
+                pool->withStatement<0>("COMMIT", [](auto &statement) {
+                    statement.execute();
+                });
+            });
+            writtenRows += 1000;
+        }
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    const auto results = runReaders(threadCount, [&](long long id) {
+        return pool->withStatement<1, 1>(selectName, [&](auto &statement) {
+            return statement.template value<Utils::SmallString>(id);
+        });
+    });
+    const qint64 elapsedMs = timer.elapsed();
+    readersDone = true;
+    writer.join();
+
+    qInfo("Connection pool while writing %d rows:", writtenRows.load());
+    report(results, elapsedMs);
+
+    std::lock_guard lock{*m_database};
+    m_database->execute("DELETE FROM rows WHERE name='written'");
+}
+
+QTEST_GUILESS_MAIN(tst_ConnectionPool)
+
+#include "tst_manual_sqlite_connectionpool.moc"
@@ -0,0 +1,153 @@
+// Copyright (C) 2024 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+// Compares the rows per second of WriteStatement::write() called for every row with
+// writeBatch() and writeBatchWithValuesList(), all in one transaction on a file database.
+//
+//   tst_manual_sqlite_writebatch rowAtATime:500k writeBatch:500k writeBatchWithValuesList:500k
+
+#include <sqlitedatabase.h>
+#include <sqlitetransaction.h>
+#include <sqlitewritestatement.h>
+
+#include <sqlite3.h>
+
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct Row
+{
+    long long id = 0;
+    Utils::SmallString name;
+};
+
+const char createTable[] = "CREATE TABLE rows(id INTEGER PRIMARY KEY, name TEXT)";
+const char insertRow[] = "INSERT INTO rows(id, name) VALUES(?1, ?2)";
+
+std::vector<Row> createRows(int count)
+{
+    std::vector<Row> rows;
+    rows.reserve(std::size_t(count));
+    for (int index = 0; index < count; ++index)
+        rows.push_back({index, Utils::SmallString::number(index) + "/file.cpp"});
+    return rows;
+}
+
+auto fields(const Row &row)
+{
+    return std::tie(row.id, row.name);
+}
+
+} // namespace
+
+class tst_WriteBatch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void rowAtATime_data() { addRowCounts(); }
+    void rowAtATime();
+    void writeBatch_data() { addRowCounts(); }
+    void writeBatch();
+    void writeBatchWithValuesList_data() { addRowCounts(); }
+    void writeBatchWithValuesList();
+
+private:
+    void addRowCounts();
+    void report(int rowCount, qint64 elapsedMs);
+
+    QTemporaryDir m_directory;
+    std::unique_ptr<Sqlite::Database> m_database;
+};
+
+void tst_WriteBatch::addRowCounts()
+{
+    QTest::addColumn<int>("rowCount");
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+    QTest::newRow("500k") << 500000;
+}
+
+void tst_WriteBatch::init()
+{
+    QVERIFY(m_directory.isValid());
+    QFile::remove(m_directory.filePath("writebatch.db"));
+    m_database = std::make_unique<Sqlite::Database>(
+        Utils::PathString{m_directory.filePath("writebatch.db")}, Sqlite::JournalMode::Wal);
+    std::lock_guard lock{*m_database};
+    m_database->execute(createTable);
+}
+
+void tst_WriteBatch::cleanup()
+{
+    m_database.reset();
+}
+
+void tst_WriteBatch::report(int rowCount, qint64 elapsedMs)
+{
+    const double rowsPerSecond = rowCount * 1000.0 / double(std::max<qint64>(elapsedMs, 1));
+    qInfo("%d rows in %lld ms, %.0f rows per second",
+          rowCount,
+          static_cast<long long>(elapsedMs),
+          rowsPerSecond);
+}
+
+void tst_WriteBatch::rowAtATime()
+{
+    QFETCH(int, rowCount);
+    const std::vector<Row> rows = createRows(rowCount);
+    Sqlite::WriteStatement<2> statement{insertRow, *m_database};
+
+    QElapsedTimer timer;
+    timer.start();
+    Sqlite::ImmediateTransaction<Sqlite::Database> transaction{*m_database};
+    for (const Row &row : rows)
+        statement.write(row.id, row.name);
+    transaction.commit();
+    report(rowCount, timer.elapsed());
+}
+
+void tst_WriteBatch::writeBatch()
+{
+    QFETCH(int, rowCount);
+    const std::vector<Row> rows = createRows(rowCount);
+    Sqlite::WriteStatement<2> statement{insertRow, *m_database};
+
+    QElapsedTimer timer;
+    timer.start();
+    statement.writeBatch(rows, fields);
+    report(rowCount, timer.elapsed());
+}
+
+void tst_WriteBatch::writeBatchWithValuesList()
+{
+    QFETCH(int, rowCount);
+    const std::vector<Row> rows = createRows(rowCount);
+    const Sqlite::WriteStatement<2> statement{insertRow, *m_database};
+    const int parameterLimit = sqlite3_limit(statement.sqliteDatabaseHandle(),
+                                             SQLITE_LIMIT_VARIABLE_NUMBER,
+                                             -1);
+
+    QElapsedTimer timer;
+    timer.start();
+    Sqlite::WriteStatement<2>::writeBatchWithValuesList("INSERT INTO rows(id, name)",
+                                                        *m_database,
+                                                        rows,
+                                                        fields,
+                                                        parameterLimit);
+    report(rowCount, timer.elapsed());
+}
+
+QTEST_GUILESS_MAIN(tst_WriteBatch)
+
+#include "tst_manual_sqlite_writebatch.moc"